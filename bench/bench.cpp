@@ -0,0 +1,297 @@
+#include <array>
+#include <chrono>
+#include <random>
+#include <string_view>
+#include "pch.hpp"
+#include "drugsim.hpp"
+#include "simulation_helper.hpp"
+#include "convert_utils.hpp"
+
+/*
+ * Micro-benchmarks of the PK kernels, the simulation tick and the input
+ * parsers. Every benchmark is timed RUNS times after calibration, ns/op is the
+ * median run and rsd is the relative standard deviation between runs.
+ *
+ * usage: drugsim_bench [filter]   (only benchmarks containing filter are run)
+*/
+
+using std::size_t;
+using std::string;
+using std::string_view;
+
+namespace TwoComp = PK::TwoCompartment;
+
+namespace
+{
+    constexpr int RUNS = 9;
+    constexpr double RUN_NS = 20e6;    // calibrated length of one run
+
+    // Parameter sets and time points are indexed with a mask, sizes are powers of two.
+    constexpr size_t DRUG_COUNT = 8;
+    constexpr size_t TIME_COUNT = 64;
+    constexpr size_t DENSE_SIZE = 4096;
+
+    string_view filter;
+
+    /* Keep value alive so its computation is not optimized away. */
+    template <typename T>
+    inline void keep(const T& value)
+    {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    /*
+     * Time fn(i) for i = 0, 1, ... and print ns per operation, a call of fn
+     * may perform several operations (e.g. one per time point).
+    */
+    template <typename Fn>
+    void bench(string_view name, Fn&& fn, size_t opsPerCall = 1)
+    {
+        if (!filter.empty() && name.find(filter) == string_view::npos)
+            return;
+
+        using Clock = std::chrono::steady_clock;
+
+        auto timeCalls = [&](size_t calls) {
+            const auto start = Clock::now();
+            for (size_t i = 0; i < calls; ++i) fn(i);
+            return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        };
+
+        size_t calls = 1;
+        while (timeCalls(calls) < RUN_NS / 4) calls *= 2;
+        calls *= 4;
+
+        std::array<double, RUNS> perOp;
+        for (auto& ns : perOp) {
+            ns = timeCalls(calls) / (calls * opsPerCall);
+        }
+
+        double mean = 0;
+        for (double ns : perOp) mean += ns / RUNS;
+
+        double variance = 0;
+        for (double ns : perOp) variance += (ns - mean) * (ns - mean) / (RUNS - 1);
+
+        std::sort(perOp.begin(), perOp.end());
+        const double median = perOp[RUNS / 2];
+
+        std::cout << std::format("{:<40}{:>12.2f}{:>9.2f}%{:>12.2f}\n", name, median,
+                                 100 * std::sqrt(variance) / mean, 1e3 / median)
+                  << std::flush;
+    }
+
+    /* Oral prodrug with delayed release, every kernel has its values. */
+    std::array<DrugInfo, DRUG_COUNT> makeDrugs()
+    {
+        std::mt19937_64 rng(42);
+        auto uniform = [&](double lo, double hi) {
+            return std::uniform_real_distribution<double>(lo, hi)(rng);
+        };
+
+        std::array<DrugInfo, DRUG_COUNT> drugs;
+
+        for (auto& drug : drugs)
+        {
+            DrugSim::DrugParams params;
+            params.roa = ROA_TYPE_ORAL;
+            params.dose = uniform(10, 500);
+            params.absorptionHalfLife = uniform(600, 3600);
+            params.halfLife = uniform(3 * 3600, 24 * 3600);
+            params.vd = uniform(5, 50);
+            params.bioavailability = uniform(0.5, 1);
+            params.ed50 = uniform(1, 10);
+            params.excretionFrac = uniform(0.1, 0.9);
+            params.activeFrac = uniform(0.2, 0.9);
+            params.activeHalfLife = uniform(2 * 3600, 12 * 3600);
+            params.drFrac = 0.5;
+            params.drLagtime = 4 * 3600;
+
+            drug = DrugSim::makeDrug(params);
+        }
+
+        return drugs;
+    }
+
+    std::array<double, TIME_COUNT> makeTimes()
+    {
+        std::mt19937_64 rng(7);
+        std::uniform_real_distribution<double> dist(0, 48 * 3600);
+
+        std::array<double, TIME_COUNT> times;
+        for (auto& t : times) t = dist(rng);
+
+        return times;
+    }
+
+    /* Simulations of the tick benchmarks, as started by the command line. */
+    std::vector<std::pair<string_view, SimulationInfo>> makeSimulations()
+    {
+        DrugSim::DrugParams iv;
+        iv.dose = 100;
+        iv.halfLife = 6 * 3600;
+
+        DrugSim::DrugParams oral = iv;
+        oral.roa = ROA_TYPE_ORAL;
+        oral.absorptionHalfLife = 1800;
+        oral.ed50 = 20;
+
+        DrugSim::DrugParams prodrug = oral;
+        prodrug.activeFrac = 0.8f;
+        prodrug.activeHalfLife = 4 * 3600;
+
+        DrugSim::DrugParams dr = oral;
+        dr.drLagtime = 4 * 3600;
+
+        DrugSim::DrugParams peripheral = oral;
+        peripheral.distributionHalfLife = 900;
+        peripheral.redistributionHalfLife = 3600;
+
+        DrugSim::DrugParams nonlinear = oral;
+        nonlinear.vd = 50;
+        nonlinear.vmax = 20.0 / 3600;
+        nonlinear.km = 4;
+
+        DrugSim::DrugParams regimen = oral;
+        regimen.schedule.emplace();
+        regimen.schedule->interval = 8 * 3600;
+        regimen.schedule->count = 10;
+
+        std::vector<std::pair<string_view, SimulationInfo>> sims = {
+            {"iv", DrugSim::makeSimulation(iv)},
+            {"oral", DrugSim::makeSimulation(oral)},
+            {"prodrug", DrugSim::makeSimulation(prodrug)},
+            {"dr", DrugSim::makeSimulation(dr)},
+            {"peripheral", DrugSim::makeSimulation(peripheral)},
+            {"nonlinear", DrugSim::makeSimulation(nonlinear)},
+            {"regimen", DrugSim::makeSimulation(regimen)},
+        };
+
+        for (auto& [name, sim] : sims) {
+            sim.precision = sim.state.prec = 3;
+            sim.state.minDisplayDose = SimHelper::getMinDisplayDose(3);
+        }
+
+        return sims;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1) filter = argv[1];
+
+    const auto drugs = makeDrugs();
+    const auto times = makeTimes();
+
+    auto drugAt = [&](size_t i) -> const DrugInfo& { return drugs[i & (DRUG_COUNT - 1)]; };
+    auto timeAt = [&](size_t i) { return times[i & (TIME_COUNT - 1)]; };
+
+    std::cout << std::format("{:<40}{:>12}{:>10}{:>12}\n", "benchmark", "ns/op", "rsd", "Mops/s");
+
+    std::array<LinearModel, DRUG_COUNT> models;
+    for (size_t i = 0; i < DRUG_COUNT; ++i) {
+        models[i] = makeLinearModel(drugs[i], TWO_COMP_MODEL);
+    }
+    auto modelAt = [&](size_t i) -> const LinearModel& { return models[i & (DRUG_COUNT - 1)]; };
+
+    /* Scalar kernels, one call per operation. */
+    bench("linear/makeLinearModel", [&](size_t i) {
+        keep(makeLinearModel(drugAt(i), TWO_COMP_MODEL).step);
+    });
+    bench("linear/matrixExp", [&](size_t i) {
+        keep(matrixExp(modelAt(i).rates)[0][0]);
+    });
+    bench("linear/at", [&](size_t i) {
+        keep(modelAt(i).at(timeAt(i)));
+    });
+    bench("2comp/computeIsAbsorbed", [&](size_t i) {
+        keep(TwoComp::computeIsAbsorbed(drugAt(i), timeAt(i)));
+    });
+    bench("2comp/computeTmax", [&](size_t i) {
+        keep(TwoComp::computeTmax(drugAt(i)));
+    });
+    bench("computeEffectiveness", [&](size_t i) {
+        keep(PK::computeEffectiveness(drugAt(i).ed50, timeAt(i) / 3600));
+    });
+    bench("computeSteadyState", [&](size_t i) {
+        keep(computeSteadyState(drugAt(i), TWO_COMP_MODEL, 8 * 3600.0).max);
+    });
+
+    /* Dense kernels, one operation per time point. */
+    std::vector<double> denseTimes(DENSE_SIZE), denseOut(DENSE_SIZE);
+    for (size_t i = 0; i < DENSE_SIZE; ++i) {
+        denseTimes[i] = i * 48.0 * 3600 / DENSE_SIZE;
+    }
+
+    std::vector<LinearModel::Vector> denseStates(DENSE_SIZE);
+    std::vector<NonlinearModel::Vector> nonlinearStates(DENSE_SIZE);
+
+    bench("linear/sample[dense]", [&](size_t i) {
+        modelAt(i).sample(denseTimes, denseStates);
+        keep(denseStates.front());
+    }, DENSE_SIZE);
+    bench("computeEffectiveness[dense]", [&](size_t i) {
+        PK::computeEffectiveness(drugAt(i).ed50, denseTimes, denseOut);
+        keep(denseOut.front());
+    }, DENSE_SIZE);
+
+    /* Simulation tick of each kind of simulation. */
+    for (auto& [name, sim] : makeSimulations())
+    {
+        auto& state = sim.state;
+        const string prefix = std::format("tick/{}/", name);
+
+        bench(prefix + "updateCurrentDoses", [&](size_t i) {
+            state.elapsed = timeAt(i);
+            SimHelper::updateCurrentDoses(sim);
+            keep(state.drugContent);
+        });
+        bench(prefix + "updateCache", [&](size_t i) {
+            SimHelper::updateCache(sim);
+            keep(sim.cache.output.length);
+        });
+        bench(prefix + "updateTick", [&](size_t i) {
+            state.elapsed = timeAt(i);
+            SimHelper::updateTick(sim);
+            keep(sim.cache.output.length);
+        });
+
+        /* Dense output of whatever evaluates the simulation's curve. */
+        if (sim.regimen.has_value()) {
+            const auto& regimen = *sim.regimen;
+            bench(prefix + "RegimenCurve::value[dense]", [&](size_t i) {
+                for (size_t j = 0; j < DENSE_SIZE; ++j) denseOut[j] = regimen.value(denseTimes[j]);
+                keep(denseOut.front());
+            }, DENSE_SIZE);
+        }
+        else if (sim.nonlinear.has_value()) {
+            bench(prefix + "NonlinearModel::sample[dense]", [&](size_t i) {
+                sim.nonlinear->sample(denseTimes, nonlinearStates);
+                keep(nonlinearStates.front());
+            }, DENSE_SIZE);
+        }
+        else {
+            bench(prefix + "computeDrugContent[dense]", [&](size_t i) {
+                computeDrugContent(sim, denseTimes, denseOut);
+                keep(denseOut.front());
+            }, DENSE_SIZE);
+        }
+    }
+
+    /* Input parsers, varied inputs of the forms accepted on the command line. */
+    const std::array<string, 8> timeInputs = {
+        "30", "1 h", "2.5 min", "12 hours", "1/2 day", "90 s", "45m", "3 d"
+    };
+    const std::array<string, 8> doseInputs = {
+        "25 mg", "1 g", "500 mcg", "0.5 mg/L", "10 ng/mL", "100", "1/2 g", "2 mg/kg"
+    };
+
+    bench("parse/timeInputToSeconds", [&](size_t i) {
+        keep(timeInputToSeconds(timeInputs[i & 7]));
+    });
+    bench("parse/parseDoseInput", [&](size_t i) {
+        keep(parseDoseInput(doseInputs[i & 7]).value);
+    });
+
+    return 0;
+}
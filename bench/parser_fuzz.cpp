@@ -0,0 +1,263 @@
+#include <cmath>
+#include <iomanip>
+#include <random>
+#include <regex>
+#include <sstream>
+#include "pch.hpp"
+#include "convert_utils.hpp"
+#include "time_utils.hpp"
+
+/*
+ * Differential fuzzer of the input parsers against the std::regex versions
+ * they replaced. Random inputs built from number, unit and separator pieces
+ * are given to both, every input accepted by the old parser must give the same
+ * value and units, and rejected inputs must be rejected by both.
+ *
+ * usage: drugsim_fuzz [seed] [inputs]   (exits 1 if any input differs)
+*/
+
+using std::string;
+
+namespace
+{
+    /* The regex parsers as they were before the from_chars rewrite. */
+    namespace Regex
+    {
+        using namespace UnitConverter;
+
+        const std::regex numberUnitRe{"^(\\d*?\\.?\\d+?)(?:\\s?([a-zA-Z/]+?))?$"};
+        const std::regex doseRe{
+            "^((?:\\d*?\\.)?\\d+)(?:\\s*?([a-z]+)(?:/?([a-z]+)?))?$",
+            std::regex::icase
+        };
+        const std::regex fractionRe{"((?:\\d*?\\.)?\\d+)/((?:\\d*?\\.)?\\d+)"};
+        const std::regex percentageRe{R"(((?:\d*\.)?\d+)%)"};
+        const std::regex hhmmRe{R"((\d{2}):?(\d{2})(?::(\d{2}))?)"};
+
+        void setFractionsToDecimal(string& text)
+        {
+            std::vector<std::smatch> matches;
+            for (std::sregex_iterator it(text.begin(), text.end(), fractionRe), end; it != end; ++it) {
+                matches.push_back(*it);
+            }
+
+            for (auto it = matches.rbegin(); it != matches.rend(); ++it) {
+                const double val = std::stod((*it)[1].str()) / std::stod((*it)[2].str());
+                text.replace(it->position(), it->length(), std::to_string(val));
+            }
+        }
+
+        void setPercentagesToDecimal(string& text)
+        {
+            std::vector<std::smatch> matches;
+            for (std::sregex_iterator it(text.begin(), text.end(), percentageRe), end; it != end; ++it) {
+                matches.push_back(*it);
+            }
+
+            for (auto it = matches.rbegin(); it != matches.rend(); ++it) {
+                const float val = std::stof((*it)[1].str()) * 0.01f;
+
+                std::ostringstream oss;
+                oss << std::setprecision(6) << std::noshowpoint << val;
+
+                text.replace(it->position(), it->length(), oss.str());
+            }
+        }
+
+        double timeInputToSeconds(string text)
+        {
+            setFractionsToDecimal(text);
+
+            std::smatch match;
+            if (!std::regex_search(text, match, numberUnitRe)) {
+                throw std::runtime_error("invalid number input");
+            }
+
+            double sec = std::stod(match[1].str());
+            if (match[2].matched) {
+                sec *= Time::toSecondsFactor(stringToUnit<TIME_UNIT>(match[2].str()));
+            }
+            return sec;
+        }
+
+        ParsedDose parseDoseInput(string text)
+        {
+            setFractionsToDecimal(text);
+
+            std::smatch match;
+            if (!std::regex_search(text, match, doseRe)) {
+                throw std::invalid_argument("invalid dose input");
+            }
+
+            ParsedDose result;
+            result.value = std::stod(match[1].str());
+
+            if (match[2].matched) {
+                result.doseUnit = stringToUnit<DOSE_UNIT>(match[2].str());
+                result.useDoseUnit = true;
+            }
+            if (match[3].matched) {
+                result.baseUnit = stringToUnit<BASE_UNIT>(match[3].str());
+                result.useBaseUnit = true;
+            }
+            return result;
+        }
+
+        double hhmmToSeconds(const string& hhmm)
+        {
+            std::smatch match;
+            if (!std::regex_search(hhmm, match, hhmmRe)) {
+                throw std::invalid_argument("invalid hhmm format");
+            }
+
+            const int s = match[3].matched ? std::stoi(match[3].str()) : 0;
+            return std::stoi(match[1].str()) * 3600 + std::stoi(match[2].str()) * 60 + s;
+        }
+    }
+
+    /* Pieces inputs are built from, including the edge cases of each grammar. */
+    const std::vector<string> pieces = {
+        "0", "1", "2", "9", "12", "00", ".", "/", "%", ":", " ", "  ", "\t", "\n", "-",
+        "mg", "g", "mcg", "ug", "ng", "L", "ml", "mL", "kg", "Mg", "MG",
+        "h", "hr", "hours", "min", "m", "s", "sec", "d", "day", "days", "x", "/L",
+        "1/2", "0.5", "5%", "1/0", "0/0", "e", "E5", "1234",
+        "99999999999999999999999999999", "0.0000000000000001",
+        string(400, '9'), "0." + string(400, '0') + "1",
+    };
+
+    const std::string_view rawChars = "0123456789./%: mgLh\t";
+
+    /* Result of a parser, the value text or the kind of error thrown. */
+    struct Outcome {
+        bool isAccepted = false;
+        string value;
+    };
+
+    template <typename Fn>
+    Outcome run(Fn fn)
+    {
+        try {
+            return {true, fn()};
+        }
+        catch (const std::exception&) {
+            return {false, ""};
+        }
+    }
+
+    string format(double value)
+    {
+        return std::format("{:.17g}", value);
+    }
+
+    string format(const ParsedDose& dose)
+    {
+        return std::format("{} {} {} {}", static_cast<int>(dose.doseUnit),
+                           static_cast<int>(dose.baseUnit), dose.useDoseUnit, dose.useBaseUnit);
+    }
+
+    /*
+     * Values are equal, or equal within the rounding of fractions to six
+     * decimals by std::to_string that the regex versions did before scaling
+     * by the unit (a week in seconds at most).
+    */
+    bool isSameValue(double a, double b)
+    {
+        return a == b || std::fabs(a - b) <= 1e-4 * std::max(1.0, std::fabs(a)) + 1e-6 * 604800;
+    }
+
+    string randomInput(std::mt19937_64& rng)
+    {
+        string text;
+
+        if (rng() % 4 == 0) {
+            for (auto n = rng() % 10; n > 0; --n) text += rawChars[rng() % rawChars.size()];
+            return text;
+        }
+
+        for (auto n = 1 + rng() % 5; n > 0; --n) text += pieces[rng() % pieces.size()];
+        return text;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::mt19937_64 rng(argc > 1 ? std::stoull(argv[1]) : 1);
+    const long inputs = argc > 2 ? std::stol(argv[2]) : 50000;
+
+    long accepted = 0;
+    long failures = 0;
+
+    auto report = [&](std::string_view parser, const string& input,
+                      const Outcome& old, const Outcome& now) {
+        if (failures++ < 40) {
+            std::cout << std::format("{} [{}] regex={}:{} parser={}:{}\n", parser, input,
+                                     old.isAccepted, old.value, now.isAccepted, now.value);
+        }
+    };
+
+    for (long i = 0; i < inputs; ++i)
+    {
+        const string s = randomInput(rng);
+
+        /* Numbers with a unit, values within fraction rounding. */
+        {
+            auto old = run([&] { return format(Regex::timeInputToSeconds(s)); });
+            auto now = run([&] { return format(timeInputToSeconds(s)); });
+
+            if (old.isAccepted) ++accepted;
+            if (old.isAccepted != now.isAccepted ||
+                (old.isAccepted && !isSameValue(std::stod(old.value), std::stod(now.value))))
+            {
+                report("time", s, old, now);
+            }
+        }
+
+        {
+            ParsedDose oldDose, newDose;
+            auto old = run([&] { oldDose = Regex::parseDoseInput(s); return format(oldDose); });
+            auto now = run([&] { newDose = parseDoseInput(s); return format(newDose); });
+
+            if (old.isAccepted) ++accepted;
+            if (old.isAccepted != now.isAccepted ||
+                (old.isAccepted && (old.value != now.value ||
+                                    !isSameValue(oldDose.value, newDose.value))))
+            {
+                report("dose", s, old, now);
+            }
+        }
+
+        /*
+         * Replaced text must be identical. The regex versions could throw on
+         * text they had already replaced through stale matches, only the text
+         * they replaced successfully is compared.
+        */
+        {
+            auto old = run([&] { auto t = s; Regex::setFractionsToDecimal(t); return t; });
+            auto now = run([&] { auto t = s; setFractionsToDecimal(t); return t; });
+            if (old.isAccepted && (!now.isAccepted || old.value != now.value)) {
+                report("fraction", s, old, now);
+            }
+        }
+
+        {
+            auto old = run([&] { auto t = s; Regex::setPercentagesToDecimal(t); return t; });
+            auto now = run([&] { auto t = s; setPercentagesToDecimal(t); return t; });
+            if (old.isAccepted && (!now.isAccepted || old.value != now.value)) {
+                report("percentage", s, old, now);
+            }
+        }
+
+        {
+            auto old = run([&] { return format(Regex::hhmmToSeconds(s)); });
+            auto now = run([&] { return format(hhmmToSeconds(s).count()); });
+            if (old.isAccepted != now.isAccepted || old.value != now.value) {
+                report("hhmm", s, old, now);
+            }
+        }
+    }
+
+    std::cout << std::format("{} inputs, {} accepted by the regex parsers, {} differ\n",
+                             inputs, accepted, failures);
+
+    return failures == 0 ? 0 : 1;
+}
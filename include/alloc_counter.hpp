@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+
+/*
+ * Counts heap allocations made through operator new, used to check that the
+ * simulation loops do not allocate once they are running.
+*/
+namespace AllocCounter
+{
+    std::size_t count();
+}
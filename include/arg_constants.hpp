@@ -1,64 +1,167 @@
 #pragma once
 
-#include <string>
 #include <array>
-#include <map>
+#include <string_view>
+#include <utility>
 
-inline std::string ARG_TIME_PARAM = "<time>[ unit]";
-inline std::string ARG_DATE_PARAM = "<4+YMMDD hhmm[:ss]>";
+inline constexpr std::string_view ARG_TIME_PARAM = "<time>[ unit]";
+inline constexpr std::string_view ARG_DATE_PARAM = "<4+YMMDD hhmm[:ss]>";
 
-inline std::string ARG_TIME_DESC = "time at administration (accepts 12-hour format)";
-inline std::string ARG_DATE_DESC = "date and time of drug administration (accepts USA format)";
-inline std::string ARG_ELAPSED_DESC = "time elapsed since drug was given";
-inline std::string ARG_DOSE_DESC = "dose of drug administered";
-inline std::string ARG_COUNT_DESC = "number of doses administered";
-inline std::string ARG_T12_DESC = "elimination half-life";
-inline std::string ARG_T12ABS_DESC = "absorption half-life";
-inline std::string ARG_PRECISION_DESC = "decimal precision (default: 0)";
-inline std::string ARG_LAGTIME_DESC = "time for drug to reach systemic circulation";
-inline std::string ARG_ROA_DESC = "route of administration";
-inline std::string ARG_BIO_DESC = "bioavailability";
-inline std::string ARG_MAX_DESC = "display max concentration achieved";
-inline std::string ARG_MIN_DESC = "minimum dose allowed to be displayed";
-inline std::string ARG_PRODRUG_DESC = "fraction of prodrug converts into active drug";
-inline std::string ARG_T12M_DESC = "half-life of metabolite";
-inline std::string ARG_DR_DESC = "time until delayed dose is released";
-inline std::string ARG_DR_FRAC_DESC = "fraction of dose is delayed form";
-inline std::string ARG_VOLUME_DESC = "volume of distribution in liters";
-inline std::string ARG_ED50_DESC = "dose required to obtain half effectiveness";
+inline constexpr std::string_view ARG_TIME_DESC = "time at administration (accepts 12-hour format)";
+inline constexpr std::string_view ARG_DATE_DESC = "date and time of drug administration (accepts USA format)";
+inline constexpr std::string_view ARG_ELAPSED_DESC = "time elapsed since drug was given";
+inline constexpr std::string_view ARG_DOSE_DESC = "dose of drug administered";
+inline constexpr std::string_view ARG_COUNT_DESC = "number of doses administered";
+inline constexpr std::string_view ARG_T12_DESC = "elimination half-life";
+inline constexpr std::string_view ARG_T12ABS_DESC = "absorption half-life";
+inline constexpr std::string_view ARG_PRECISION_DESC = "decimal precision (default: 0)";
+inline constexpr std::string_view ARG_LAGTIME_DESC = "time for drug to reach systemic circulation";
+inline constexpr std::string_view ARG_ROA_DESC = "route of administration";
+inline constexpr std::string_view ARG_BIO_DESC = "bioavailability";
+inline constexpr std::string_view ARG_MAX_DESC = "display max concentration achieved";
+inline constexpr std::string_view ARG_MIN_DESC = "minimum dose allowed to be displayed";
+inline constexpr std::string_view ARG_PRODRUG_DESC = "fraction of prodrug converts into active drug";
+inline constexpr std::string_view ARG_T12M_DESC = "half-life of metabolite";
+inline constexpr std::string_view ARG_T12DIST_DESC = "half-life of distribution into peripheral tissue";
+inline constexpr std::string_view ARG_T12REDIST_DESC = "half-life of return from peripheral tissue";
+inline constexpr std::string_view ARG_VMAX_DESC = "maximum elimination rate per hour (saturable elimination)";
+inline constexpr std::string_view ARG_KM_DESC = "content at half the maximum elimination rate";
+inline constexpr std::string_view ARG_DR_DESC = "time until delayed dose is released";
+inline constexpr std::string_view ARG_DR_FRAC_DESC = "fraction of dose is delayed form";
+inline constexpr std::string_view ARG_VOLUME_DESC = "volume of distribution in liters";
+inline constexpr std::string_view ARG_ED50_DESC = "dose required to obtain half effectiveness";
+inline constexpr std::string_view ARG_BATCH_DESC = "evaluate a time grid without real-time display";
+inline constexpr std::string_view ARG_POPULATION_DESC = "number of virtual subjects to simulate over the batch grid";
+inline constexpr std::string_view ARG_CV_DESC = "population coefficient of variation of ka,ke,vd,F";
+inline constexpr std::string_view ARG_EVERY_DESC = "time between repeated doses";
+inline constexpr std::string_view ARG_DOSES_DESC = "number of repeated doses (default: unlimited)";
+inline constexpr std::string_view ARG_LOADING_DESC = "loading dose given instead of the first dose";
+inline constexpr std::string_view ARG_SCHEDULE_DESC = "extra doses at times after the first dose";
+inline constexpr std::string_view ARG_INFUSION_DESC = "doses infused at a constant rate over a duration";
+inline constexpr std::string_view ARG_STEADY_DESC = "report the steady state of the repeated dose instead of simulating";
+inline constexpr std::string_view ARG_RATE_DESC = "display updates per second (default: 20)";
+inline constexpr std::string_view ARG_SPEED_DESC = "run the clock n times faster than real time (default: 1)";
+inline constexpr std::string_view ARG_VIRTUAL_DESC = "advance the clock one tick at a time without sleeping";
+inline constexpr std::string_view ARG_EXPORT_DESC = "stream every sample as csv (tsv for .tsv, columns for .bin)";
+inline constexpr std::string_view ARG_COMBINE_DESC = "sum the active drug of every config (shared moiety)";
 
 namespace Args
 {
-    struct Metadata { std::string flag; std::string param; std::string desc; };
+    /* Index of each arg in an ArgParser, in the order of globalArgs. */
+    enum ARG_ID {
+        ARG_ID_TIME,
+        ARG_ID_DATE,
+        ARG_ID_ELAPSED,
+        ARG_ID_DOSE,
+        ARG_ID_COUNT,
+        ARG_ID_T12,
+        ARG_ID_T12ABS,
+        ARG_ID_PRECISION,
+        ARG_ID_LAGTIME,
+        ARG_ID_ROA,
+        ARG_ID_BIOAVAILABILITY,
+        ARG_ID_MAX,
+        ARG_ID_MIN,
+        ARG_ID_PRODRUG,
+        ARG_ID_T12M,
+        ARG_ID_T12DIST,
+        ARG_ID_T12REDIST,
+        ARG_ID_VMAX,
+        ARG_ID_KM,
+        ARG_ID_DR,
+        ARG_ID_DR_FRAC,
+        ARG_ID_MSG,
+        ARG_ID_FILE,
+        ARG_ID_LIST,
+        ARG_ID_COMBINE,
+        ARG_ID_ALLOCS,
+        ARG_ID_PROFILE,
+        ARG_ID_EXPORT,
+        ARG_ID_READ,
+        ARG_ID_SERVE,
+        ARG_ID_CLIENT,
+        ARG_ID_AUC,
+        ARG_ID_VOLUME,
+        ARG_ID_ED50,
+        ARG_ID_EXCRETION,
+        ARG_ID_SIGFIGS,
+        ARG_ID_BATCH,
+        ARG_ID_POPULATION,
+        ARG_ID_CV,
+        ARG_ID_SEED,
+        ARG_ID_EVERY,
+        ARG_ID_DOSES,
+        ARG_ID_LOADING,
+        ARG_ID_SCHEDULE,
+        ARG_ID_INFUSION,
+        ARG_ID_STEADY,
+        ARG_ID_RATE,
+        ARG_ID_SPEED,
+        ARG_ID_VIRTUAL,
+        ARG_ID_TOTAL,
+    };
 
-    inline const Metadata TIME = {"--time", "<hhmm[:ss]>", ARG_TIME_DESC};
-    inline const Metadata DATE = {"--date", ARG_DATE_PARAM, ARG_DATE_DESC};
-    inline const Metadata ELAPSED = {"--elapsed", "<hhmm[:ss]|time unit>", ARG_ELAPSED_DESC};
-    inline const Metadata DOSE = {"--dose", "<dose>[ unit]", ARG_DOSE_DESC};
-    inline const Metadata COUNT = {"--count", "<n>", ARG_COUNT_DESC};
-    inline const Metadata T12 = {"--t12", ARG_TIME_PARAM, ARG_T12_DESC};
-    inline const Metadata T12ABS = {"--t12abs", ARG_TIME_PARAM, ARG_T12ABS_DESC};
-    inline const Metadata PRECISION = {"-p", "<n>", ARG_PRECISION_DESC};
-    inline const Metadata SIGFIGS = {"--sigfigs", "<n>", "sigfigs to round results to"};
-    inline const Metadata LAGTIME = {"--lagtime", ARG_TIME_PARAM, ARG_LAGTIME_DESC};
-    inline const Metadata ROA = {"--roa", "<roa>", ARG_ROA_DESC};
-    inline const Metadata BIOAVAILABILITY = {"-F", "<decimal>", ARG_BIO_DESC};
-    inline const Metadata PRODRUG = {"--prodrug", "<decimal>", ARG_PRODRUG_DESC};
-    inline const Metadata T12M = {"--t12m", ARG_TIME_PARAM, ARG_T12M_DESC};
-    inline const Metadata MAX = {"--max", "", ARG_MAX_DESC};
-    inline const Metadata MIN = {"--min", "<dose>[ unit]", ARG_MIN_DESC};
-    inline const Metadata DR = {"--dr", ARG_TIME_PARAM, ARG_DR_DESC};
-    inline const Metadata DR_FRAC = {"--dr-frac", "<decimal>", ARG_DR_FRAC_DESC};
-    inline const Metadata MSG = {"--msg", "<msg>", "custom start message"};
-    inline const Metadata ARG_FILE = {"--file", "<name>", "custom file config"};
-    inline const Metadata AUC = {"--auc", "", "display area under curve"};
-    inline const Metadata VOLUME = {"--volume", "<n>", ARG_VOLUME_DESC};
-    inline const Metadata ED50 = {"--ed50", "<dose>[ unit]", ARG_ED50_DESC};
-    inline const Metadata EXCRETION = {"--excretion", "<decimal>", "fraction of drug excreted unchanged"};
+    struct Metadata {
+        ARG_ID id;
+        std::string_view flag;
+        std::string_view param;
+        std::string_view desc;
+        bool isRepeatable = false; // repeated values are joined with ','
+    };
+
+    inline constexpr Metadata TIME = {ARG_ID_TIME, "--time", "<hhmm[:ss]>", ARG_TIME_DESC};
+    inline constexpr Metadata DATE = {ARG_ID_DATE, "--date", ARG_DATE_PARAM, ARG_DATE_DESC};
+    inline constexpr Metadata ELAPSED = {ARG_ID_ELAPSED, "--elapsed", "<hhmm[:ss]|time unit>", ARG_ELAPSED_DESC};
+    inline constexpr Metadata DOSE = {ARG_ID_DOSE, "--dose", "<dose>[ unit]", ARG_DOSE_DESC};
+    inline constexpr Metadata COUNT = {ARG_ID_COUNT, "--count", "<n>", ARG_COUNT_DESC};
+    inline constexpr Metadata T12 = {ARG_ID_T12, "--t12", ARG_TIME_PARAM, ARG_T12_DESC};
+    inline constexpr Metadata T12ABS = {ARG_ID_T12ABS, "--t12abs", ARG_TIME_PARAM, ARG_T12ABS_DESC};
+    inline constexpr Metadata PRECISION = {ARG_ID_PRECISION, "-p", "<n>", ARG_PRECISION_DESC};
+    inline constexpr Metadata SIGFIGS = {ARG_ID_SIGFIGS, "--sigfigs", "<n>", "sigfigs to round results to"};
+    inline constexpr Metadata LAGTIME = {ARG_ID_LAGTIME, "--lagtime", ARG_TIME_PARAM, ARG_LAGTIME_DESC};
+    inline constexpr Metadata ROA = {ARG_ID_ROA, "--roa", "<roa>", ARG_ROA_DESC};
+    inline constexpr Metadata BIOAVAILABILITY = {ARG_ID_BIOAVAILABILITY, "-F", "<decimal>", ARG_BIO_DESC};
+    inline constexpr Metadata PRODRUG = {ARG_ID_PRODRUG, "--prodrug", "<decimal>", ARG_PRODRUG_DESC};
+    inline constexpr Metadata T12M = {ARG_ID_T12M, "--t12m", ARG_TIME_PARAM, ARG_T12M_DESC};
+    inline constexpr Metadata T12DIST = {ARG_ID_T12DIST, "--t12dist", ARG_TIME_PARAM, ARG_T12DIST_DESC};
+    inline constexpr Metadata T12REDIST = {ARG_ID_T12REDIST, "--t12redist", ARG_TIME_PARAM, ARG_T12REDIST_DESC};
+    inline constexpr Metadata VMAX = {ARG_ID_VMAX, "--vmax", "<dose>[ unit]", ARG_VMAX_DESC};
+    inline constexpr Metadata KM = {ARG_ID_KM, "--km", "<dose>[ unit]", ARG_KM_DESC};
+    inline constexpr Metadata MAX = {ARG_ID_MAX, "--max", "", ARG_MAX_DESC};
+    inline constexpr Metadata MIN = {ARG_ID_MIN, "--min", "<dose>[ unit]", ARG_MIN_DESC};
+    inline constexpr Metadata DR = {ARG_ID_DR, "--dr", ARG_TIME_PARAM, ARG_DR_DESC};
+    inline constexpr Metadata DR_FRAC = {ARG_ID_DR_FRAC, "--dr-frac", "<decimal>", ARG_DR_FRAC_DESC};
+    inline constexpr Metadata MSG = {ARG_ID_MSG, "--msg", "<msg>", "custom start message"};
+    inline constexpr Metadata ARG_FILE = {ARG_ID_FILE, "--file", "<name>[,...]", "custom file config", true};
+    inline constexpr Metadata LIST = {ARG_ID_LIST, "--list", "<path>", "file with one config name per line"};
+    inline constexpr Metadata COMBINE = {ARG_ID_COMBINE, "--combine", "", ARG_COMBINE_DESC};
+    inline constexpr Metadata EXPORT = {ARG_ID_EXPORT, "--export", "<path|->", ARG_EXPORT_DESC};
+    inline constexpr Metadata READ = {ARG_ID_READ, "--read", "<path>", "print a .bin export as tsv"};
+    inline constexpr Metadata SERVE = {ARG_ID_SERVE, "--serve", "<socket>", "answer json queries on a unix socket"};
+    inline constexpr Metadata CLIENT = {ARG_ID_CLIENT, "--client", "<socket>", "send stdin lines to a server, print replies"};
+    inline constexpr Metadata PROFILE = {ARG_ID_PROFILE, "--profile", "", "report time spent in each stage of the simulation loop"};
+    inline constexpr Metadata ALLOCS = {ARG_ID_ALLOCS, "--allocs", "", "report heap allocations of the simulation loop"};
+    inline constexpr Metadata AUC = {ARG_ID_AUC, "--auc", "", "display area under curve"};
+    inline constexpr Metadata VOLUME = {ARG_ID_VOLUME, "--volume", "<n>", ARG_VOLUME_DESC};
+    inline constexpr Metadata ED50 = {ARG_ID_ED50, "--ed50", "<dose>[ unit]", ARG_ED50_DESC};
+    inline constexpr Metadata EXCRETION = {ARG_ID_EXCRETION, "--excretion", "<decimal>", "fraction of drug excreted unchanged"};
+    inline constexpr Metadata BATCH = {ARG_ID_BATCH, "--batch", "<start>:<end>:<step>", ARG_BATCH_DESC};
+    inline constexpr Metadata POPULATION = {ARG_ID_POPULATION, "--population", "<n>", ARG_POPULATION_DESC};
+    inline constexpr Metadata CV = {ARG_ID_CV, "--cv", "<decimal>[,...]", ARG_CV_DESC};
+    inline constexpr Metadata SEED = {ARG_ID_SEED, "--seed", "<n>", "random seed of population mode"};
+    inline constexpr Metadata EVERY = {ARG_ID_EVERY, "--every", ARG_TIME_PARAM, ARG_EVERY_DESC};
+    inline constexpr Metadata DOSES = {ARG_ID_DOSES, "--doses", "<n>", ARG_DOSES_DESC};
+    inline constexpr Metadata LOADING = {ARG_ID_LOADING, "--loading", "<dose>[ unit]", ARG_LOADING_DESC};
+    inline constexpr Metadata SCHEDULE = {ARG_ID_SCHEDULE, "--schedule", "<time>[@dose][,...]", ARG_SCHEDULE_DESC};
+    inline constexpr Metadata INFUSION = {ARG_ID_INFUSION, "--infusion", "<dose>[ unit]/<time>[@start][,...]", ARG_INFUSION_DESC, true};
+    inline constexpr Metadata STEADY = {ARG_ID_STEADY, "--steady", "", ARG_STEADY_DESC};
+    inline constexpr Metadata RATE = {ARG_ID_RATE, "--rate", "<hz>", ARG_RATE_DESC};
+    inline constexpr Metadata SPEED = {ARG_ID_SPEED, "--speed", "<n>", ARG_SPEED_DESC};
+    inline constexpr Metadata VIRTUAL = {ARG_ID_VIRTUAL, "--virtual", "", ARG_VIRTUAL_DESC};
 }
 
 /* All commands available. */
-inline constexpr std::array<const Args::Metadata*, 24> globalArgs=
+inline constexpr std::array<const Args::Metadata*, Args::ARG_ID_TOTAL> globalArgs =
 {
     &Args::TIME,
     &Args::DATE,
@@ -75,19 +178,54 @@ inline constexpr std::array<const Args::Metadata*, 24> globalArgs=
     &Args::MIN,
     &Args::PRODRUG,
     &Args::T12M,
+    &Args::T12DIST,
+    &Args::T12REDIST,
+    &Args::VMAX,
+    &Args::KM,
     &Args::DR,
     &Args::DR_FRAC,
     &Args::MSG,
     &Args::ARG_FILE,
+    &Args::LIST,
+    &Args::COMBINE,
+    &Args::ALLOCS,
+    &Args::PROFILE,
+    &Args::EXPORT,
+    &Args::READ,
+    &Args::SERVE,
+    &Args::CLIENT,
     &Args::AUC,
     &Args::VOLUME,
     &Args::ED50,
     &Args::EXCRETION,
     &Args::SIGFIGS,
+    &Args::BATCH,
+    &Args::POPULATION,
+    &Args::CV,
+    &Args::SEED,
+    &Args::EVERY,
+    &Args::DOSES,
+    &Args::LOADING,
+    &Args::SCHEDULE,
+    &Args::INFUSION,
+    &Args::STEADY,
+    &Args::RATE,
+    &Args::SPEED,
+    &Args::VIRTUAL,
 };
 
+constexpr bool isIndexedById(const auto& args)
+{
+    for (std::size_t i = 0; i < args.size(); ++i) {
+        if (args[i]->id != i) return false;
+    }
+    return true;
+}
+
+static_assert(isIndexedById(globalArgs));
+
 /* Args associated with their config param, e.g. {arg, str} = {"dose": "25 mg"} */
-inline const std::map<const Args::Metadata*, std::string> configArgs
+inline constexpr std::pair<const Args::Metadata*, std::string_view> configArgs[] =
 {
     {&Args::DOSE, "dose"},
     {&Args::COUNT, "count"},
@@ -101,6 +239,10 @@ inline const std::map<const Args::Metadata*, std::string> configArgs
     {&Args::MIN, "min"},
     {&Args::PRODRUG, "prodrug"},
     {&Args::T12M, "t12m"},
+    {&Args::T12DIST, "t12dist"},
+    {&Args::T12REDIST, "t12redist"},
+    {&Args::VMAX, "vmax"},
+    {&Args::KM, "km"},
     {&Args::DR, "dr"},
     {&Args::DR_FRAC, "dr-frac"},
     {&Args::MSG, "msg"},
@@ -108,4 +250,11 @@ inline const std::map<const Args::Metadata*, std::string> configArgs
     {&Args::ED50, "ed50"},
     {&Args::EXCRETION, "excretion"},
     {&Args::SIGFIGS, "sigfigs"},
+    {&Args::EVERY, "every"},
+    {&Args::DOSES, "doses"},
+    {&Args::LOADING, "loading"},
+    {&Args::SCHEDULE, "schedule"},
+    {&Args::INFUSION, "infusion"},
+    {&Args::RATE, "rate"},
+    {&Args::SPEED, "speed"},
 };
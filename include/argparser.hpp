@@ -1,24 +1,24 @@
 #pragma once
 
+#include <array>
 #include <string>
-#include <vector>
+#include <string_view>
 #include <optional>
 #include "arg_constants.hpp"
 
 struct ArgParser {
     struct Arg {
-        Args::Metadata meta;
+        const Args::Metadata* meta = nullptr; // null unless the arg was added
         std::optional<std::string> value; // value of the arg given by the user
     };
 
-    std::vector<Arg> args;
+    std::array<Arg, Args::ARG_ID_TOTAL> args; // indexed by Args::ARG_ID
 
-    void displayHelp();
-    void addArg(const Args::Metadata);
-    void sortArgs();
-    bool argExists(std::string name) const;
-    Arg& getArg(const Args::Metadata);
-    Arg& getArgByFlag(std::string flag);
-    bool isArgUsed(Args::Metadata) const;
+    void displayHelp() const;
+    void addArg(const Args::Metadata&);
+    Arg* findArg(std::string_view flag);
+    Arg& getArg(const Args::Metadata&);
+    const Arg& getArg(const Args::Metadata&) const;
+    bool isArgUsed(const Args::Metadata&) const;
     void parse(int argc, char** argv);
 };
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "simulation_info.hpp"
+
+/*
+ * Self-describing binary columnar file:
+ *
+ *   ColumnFileHeader
+ *   ColumnInfo[columnCount]
+ *   column data, rowCount doubles per column starting at the column's offset
+ *
+ * Values are in native byte order (checked with byteOrderMark) and columns
+ * are 8 byte aligned, so they are read in place from a memory map.
+*/
+inline constexpr char COLUMN_FILE_MAGIC[8] = {'D', 'R', 'U', 'G', 'C', 'O', 'L', '\0'};
+inline constexpr std::uint32_t COLUMN_FILE_VERSION = 1;
+inline constexpr std::uint32_t COLUMN_FILE_BYTE_ORDER = 0x01020304;
+
+/* Flags of ColumnFileHeader::flags. */
+enum COLUMN_FILE_FLAG : std::uint32_t {
+    COLUMN_FILE_PRODRUG = 1u << 0,
+    COLUMN_FILE_DR = 1u << 1,
+    COLUMN_FILE_VOLUME = 1u << 2,   // contents are in mg/L
+};
+
+struct ColumnFileHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrderMark;
+    std::uint64_t rowCount;
+    std::uint32_t columnCount;
+    std::uint32_t compModel;
+    std::uint32_t roa;
+    std::uint32_t flags;
+    std::uint64_t subjects;     // population size, 0 for a single simulation
+
+    /* Drug parameters, times in seconds and rates per second, NaN if unused. */
+    double dose;
+    double ka;
+    double ke;
+    double vd;
+    double bioavailability;
+    double lagtime;
+    double ed50;
+    double excretionFrac;
+    double activeKe;
+    double activeFrac;
+    double drFrac;
+    double drLagtime;
+};
+
+struct ColumnInfo {
+    char name[24];
+    char unit[16];
+    std::uint64_t offset;       // byte offset of the column from the file start
+};
+
+/* Name and unit of a column to be written. */
+struct ColumnSpec {
+    std::string_view name;
+    std::string_view unit;
+};
+
+/* Creates a column file of fixed size and fills its columns in place. */
+struct ColumnFileWriter {
+    int fd = -1;
+    char* map = nullptr;
+    std::size_t mapSize = 0;
+    std::size_t rowCount = 0;
+
+    ColumnFileWriter(const std::string& path, const SimulationInfo&,
+                     std::span<const ColumnSpec> columns, std::size_t rowCount);
+    ~ColumnFileWriter();
+
+    ColumnFileWriter(const ColumnFileWriter&) = delete;
+    ColumnFileWriter& operator=(const ColumnFileWriter&) = delete;
+
+    std::span<double> column(std::size_t i);
+    void close();
+
+private:
+    void open(const std::string& path, const SimulationInfo&,
+              std::span<const ColumnSpec> columns);
+    void release();
+};
+
+/* Read only memory map of a column file, nothing is copied or parsed. */
+struct ColumnFileReader {
+    int fd = -1;
+    const char* map = nullptr;
+    std::size_t mapSize = 0;
+
+    explicit ColumnFileReader(const std::string& path);
+    ~ColumnFileReader();
+
+    ColumnFileReader(const ColumnFileReader&) = delete;
+    ColumnFileReader& operator=(const ColumnFileReader&) = delete;
+
+    const ColumnFileHeader& header() const;
+    std::span<const ColumnInfo> columns() const;
+    std::span<const double> column(std::size_t i) const;
+    std::optional<std::size_t> find(std::string_view name) const;
+
+private:
+    void open(const std::string& path);
+    void release();
+};
+
+bool isColumnFilePath(const std::string& path);
+void dumpColumnFile(const std::string& path);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <span>
+#include <string_view>
+#include <vector>
+#include "simulation_info.hpp"
+
+/*
+ * Simulations contributing to one shared active moiety, e.g. immediate and
+ * extended release products of the same drug, or a prodrug and its active drug.
+ *
+ * Times are in seconds since the earliest administration of all simulations.
+*/
+namespace Combined
+{
+    std::vector<double> startOffsets(const std::vector<SimulationInfo>&);
+    std::string_view sharedUnit(const std::vector<SimulationInfo>&);
+    double sharedEd50(const std::vector<SimulationInfo>&);
+    void evaluate(const std::vector<SimulationInfo>&, std::span<const double> t,
+                  std::span<double> content, std::span<double> effectiveness);
+}
@@ -1,11 +1,10 @@
 #pragma once
 
+#include <array>
 #include <string>
-#include <vector>
+#include <string_view>
+#include <span>
 #include <algorithm>
-#include <unordered_map>
-#include <stdexcept>
-#include <boost/algorithm/string/predicate.hpp>
 
 // Fraction of drug absorbed to be considered complete.
 constexpr float ABSORBED_THRESHOLD = 0.98f;
@@ -48,51 +47,64 @@ enum TIME_UNIT {
     TIME_UNIT_DAY,
 };
 
-// Pharmacokinetics compartment model.
+// Clock of the live display, see SimClock.
+enum CLOCK_MODE {
+    CLOCK_REAL,     // follows the system clock
+    CLOCK_SCALED,   // runs a number of times faster than real time
+    CLOCK_VIRTUAL,  // advances a fixed step per tick without sleeping
+};
+
+/*
+ * Pharmacokinetics compartment model by route, i.e. whether the dose passes
+ * through an absorption compartment. Distribution into a peripheral
+ * compartment is set per drug (see DrugInfo::hasPeripheral).
+*/
 enum COMP_MODEL {
-    ONE_COMP_MODEL,
-    TWO_COMP_MODEL,
+    ONE_COMP_MODEL,     // bolus into the central compartment
+    TWO_COMP_MODEL,     // first-order absorption from a depot
 };
 
-/* Check if vector contains a specific element.
- * @note: strings are case-insensitive.*/
-template <typename T>
-inline bool vectorContains(const std::vector<T>& v, const T& value)
+/* Case-insensitive comparison of ASCII strings. */
+constexpr bool equalsIgnoreCase(std::string_view a, std::string_view b)
 {
-    if constexpr (std::is_same_v<T, std::string>) {
-        auto it = std::find_if(v.begin(), v.end(), [&](const std::string& s) {
-                return boost::iequals(s, value);
-        });
-
-        return it != v.end();
-    }
+    auto lower = [](char c) { return c >= 'A' && c <= 'Z' ? char(c - 'A' + 'a') : c; };
 
-    return std::find(v.begin(), v.end(), value) != v.end();
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [&](char x, char y) {
+               return lower(x) == lower(y);
+           });
 }
 
-inline const std::unordered_map<DOSE_UNIT, std::vector<std::string>>
-doseUnitToStringMap
+/*
+ * Names accepted for a unit, the first is the displayed name. Tables below are
+ * ordered by unit so they can be indexed with it.
+*/
+template <typename T>
+struct UnitNames {
+    T unit;
+    std::array<std::string_view, 5> names;  // unused names are empty
+};
+
+inline constexpr UnitNames<DOSE_UNIT> doseUnitNames[] =
 {
     {DOSE_UNIT_MG, {"mg", "milligram", "milligrams"}},
     {DOSE_UNIT_NANOGRAM, {"ng", "nanogram", "nanograms"}},
-    {DOSE_UNIT_MICROGRAM, {"mcg", "ug", "microgram", "micrograms"}},
-    {DOSE_UNIT_GRAM, {"g", "gram", "grams"}},
     {DOSE_UNIT_NANOMOLAR, {"nM", "nMol", "nanomolar", "nanomolars"}},
+    {DOSE_UNIT_MICROGRAM, {"mcg", "ug", "microgram", "micrograms"}},
     {DOSE_UNIT_MICROMOLAR, {"uM", "uMol", "micromolar", "micromolars"}},
+    {DOSE_UNIT_GRAM, {"g", "gram", "grams"}},
     {DOSE_UNIT_ML, {"mL", "milliliter", "milliliters"}},
     {DOSE_UNIT_L, {"L", "liter", "liters"}},
 };
 
-inline const std::unordered_map<BASE_UNIT, std::vector<std::string>>
-volumeUnitToStringMap
+inline constexpr UnitNames<BASE_UNIT> volumeUnitNames[] =
 {
     {BASE_UNIT_L, {"L", "liter", "liters"}},
     {BASE_UNIT_ML, {"mL", "milliliter", "milliliters"}},
     {BASE_UNIT_KG, {"kg", "kilogram", "kilograms"}},
 };
 
-inline const std::unordered_map<TIME_UNIT, std::vector<std::string>>
-timeUnitToStringMap
+inline constexpr UnitNames<TIME_UNIT> timeUnitNames[] =
 {
     {TIME_UNIT_SECOND, {"s", "sec", "second", "seconds"}},
     {TIME_UNIT_MS, {"ms", "millisecond", "milliseconds"}},
@@ -101,7 +113,7 @@ timeUnitToStringMap
     {TIME_UNIT_DAY, {"d", "day", "days"}},
 };
 
-inline const std::unordered_map<ROA_TYPE, std::vector<std::string>> roaToStringMap
+inline constexpr UnitNames<ROA_TYPE> roaNames[] =
 {
     {ROA_TYPE_IV, {"iv"}},
     {ROA_TYPE_ORAL, {"oral", "po"}},
@@ -110,22 +122,38 @@ inline const std::unordered_map<ROA_TYPE, std::vector<std::string>> roaToStringM
     {ROA_TYPE_SL, {"sl", "sublingual"}},
 };
 
-inline const std::unordered_map<ROA_TYPE, COMP_MODEL> roaToCompModelMap
+// Indexed by ROA_TYPE.
+inline constexpr COMP_MODEL roaCompModels[] =
 {
-    {ROA_TYPE_IV, ONE_COMP_MODEL},
-    {ROA_TYPE_ORAL, TWO_COMP_MODEL},
-    {ROA_TYPE_INTRANASAL, TWO_COMP_MODEL},
-    {ROA_TYPE_INHALATION, TWO_COMP_MODEL},
-    {ROA_TYPE_SL, TWO_COMP_MODEL},
+    ONE_COMP_MODEL,     // iv
+    TWO_COMP_MODEL,     // oral
+    TWO_COMP_MODEL,     // inhalation
+    TWO_COMP_MODEL,     // intranasal
+    TWO_COMP_MODEL,     // sublingual
 };
 
 template <typename T>
-inline const std::unordered_map<T, std::vector<std::string>>& getUnitStringMap()
+constexpr std::span<const UnitNames<T>> getUnitNames()
 {
-    if constexpr (std::is_same_v<T, DOSE_UNIT>) return doseUnitToStringMap;
-    else if constexpr (std::is_same_v<T, BASE_UNIT>) return volumeUnitToStringMap;
-    else if constexpr (std::is_same_v<T, TIME_UNIT>) return timeUnitToStringMap;
-    else if constexpr (std::is_same_v<T, ROA_TYPE>) return roaToStringMap;
+    if constexpr (std::is_same_v<T, DOSE_UNIT>) return doseUnitNames;
+    else if constexpr (std::is_same_v<T, BASE_UNIT>) return volumeUnitNames;
+    else if constexpr (std::is_same_v<T, TIME_UNIT>) return timeUnitNames;
+    else if constexpr (std::is_same_v<T, ROA_TYPE>) return roaNames;
+    else static_assert(!sizeof(T), "unsupported unit type");
+}
 
-    throw std::invalid_argument("unsupported unit type");
+template <typename T>
+constexpr bool isIndexedByUnit()
+{
+    const auto table = getUnitNames<T>();
+
+    for (std::size_t i = 0; i < table.size(); ++i) {
+        if (static_cast<std::size_t>(table[i].unit) != i)
+            return false;
+    }
+    return true;
 }
+
+static_assert(isIndexedByUnit<DOSE_UNIT>() && isIndexedByUnit<BASE_UNIT>() &&
+              isIndexedByUnit<TIME_UNIT>() && isIndexedByUnit<ROA_TYPE>());
+static_assert(std::size(roaCompModels) == std::size(roaNames));
@@ -1,40 +1,95 @@
 #pragma once
 
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include "common.hpp"
+#include "render_buffer.hpp"
 
 namespace UnitConverter
 {
     namespace Dose {
-        double toDefaultFactor(const DOSE_UNIT& unit);
-        double toMgPerLiterFactor(const DOSE_UNIT& unit, const BASE_UNIT& base);
+        /*
+         * Multiplier to convert specified unit to default dose unit, e.g. how
+         * many (default units) per specified unit. Indexed by DOSE_UNIT.
+         *
+         * @note default dose units are mg for mass and mL for volume
+        */
+        inline constexpr double defaultFactors[] = {
+            1,      // mg
+            1e-6,   // ng
+            1,      // nM
+            1e-3,   // mcg
+            1,      // uM
+            1e+3,   // g
+            1,      // mL
+            1e+3,   // L
+        };
+
+        constexpr double toDefaultFactor(const DOSE_UNIT& unit) { return defaultFactors[unit]; }
+        constexpr double toMgPerLiterFactor(const DOSE_UNIT& unit, const BASE_UNIT& base);
     }
 
     namespace Base {
-        double toLitersFactor(const BASE_UNIT& base);
+        // Indexed by BASE_UNIT.
+        inline constexpr double litersFactors[] = {
+            1,      // L
+            1e-3,   // mL
+            1,      // kg
+        };
+
+        constexpr double toLitersFactor(const BASE_UNIT& base) { return litersFactors[base]; }
     }
 
     namespace Time {
-        double toSecondsFactor(const TIME_UNIT& unit);
+        // Multiplier to convert specified unit to seconds, indexed by TIME_UNIT.
+        inline constexpr double secondsFactors[] = {
+            1,      // s
+            0.001,  // ms
+            60,     // min
+            3600,   // h
+            86400,  // d
+        };
+
+        constexpr double toSecondsFactor(const TIME_UNIT& unit) { return secondsFactors[unit]; }
     }
 
-    template <typename T>
-    std::string unitToString(const T& unit)
+    constexpr double Dose::toMgPerLiterFactor(const DOSE_UNIT& unit, const BASE_UNIT& base)
     {
-        const auto& map = getUnitStringMap<T>().at(unit);
-        return *std::next(map.begin(), 0);
+        return toDefaultFactor(unit) / Base::toLitersFactor(base);
     }
 
+    static_assert(std::size(Dose::defaultFactors) == std::size(doseUnitNames));
+    static_assert(std::size(Base::litersFactors) == std::size(volumeUnitNames));
+    static_assert(std::size(Time::secondsFactors) == std::size(timeUnitNames));
+
     template <typename T>
-    T stringToUnit(const std::string text)
+    constexpr std::string_view unitToString(const T& unit)
     {
-        const auto& map = getUnitStringMap<T>();
+        return getUnitNames<T>()[unit].names.front();
+    }
 
-        for (const auto& it : map) {
-            if (vectorContains(it.second, text))
-                return it.first;
+    /* Unit with the case-insensitive name text, if there is one. */
+    template <typename T>
+    constexpr std::optional<T> findUnit(std::string_view text)
+    {
+        for (const auto& it : getUnitNames<T>()) {
+            for (std::string_view name : it.names) {
+                if (!name.empty() && equalsIgnoreCase(name, text))
+                    return it.unit;
+            }
         }
 
+        return std::nullopt;
+    }
+
+    template <typename T>
+    T stringToUnit(std::string_view text)
+    {
+        if (auto unit = findUnit<T>(text))
+            return *unit;
+
         throw std::invalid_argument("could not convert string to unit");
     }
 };
@@ -47,10 +102,12 @@ struct ParsedDose {
     bool useBaseUnit = false;
 };
 
-double timeInputToSeconds(std::string text);
-ParsedDose parseDoseInput(std::string text);
+double timeInputToSeconds(std::string_view text);
+ParsedDose parseDoseInput(std::string_view text);
 void setFractionsToDecimal(std::string& text);
 void setPercentagesToDecimal(std::string& text);
 std::string formatSigFigs(const double& value, const int& sigfigs);
 std::string formatSeconds(float s);
+void appendSigFigs(RenderBuffer& out, double value, int sigfigs);
+void appendSeconds(RenderBuffer& out, float s);
 bool isDoseUnitVolume(const DOSE_UNIT& unit);
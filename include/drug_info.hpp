@@ -1,8 +1,26 @@
 #pragma once
 
 #include <optional>
+#include <utility>
+#include <vector>
 #include "common.hpp"
 
+/* Constant rate (zero-order) infusion into the central compartment. */
+struct Infusion {
+    double start = 0;       // time after the first dose
+    double duration = 0;
+    double rate = 0;        // milligrams per second
+};
+
+/* Repeated and irregular dosing, doses are in milligrams and times in seconds. */
+struct DoseSchedule {
+    double interval = 0;                  // time between repeated doses
+    std::size_t count = 1;                // number of repeated doses
+    std::optional<double> loadingDose;    // given instead of the first dose
+    std::vector<std::pair<double, double>> extraDoses; // {time, dose}
+    std::vector<Infusion> infusions;      // intravenous only
+};
+
 struct DrugInfo {
     ROA_TYPE roa = ROA_TYPE_IV;
     float vd = 1;                 // volume of distribution
@@ -20,8 +38,21 @@ struct DrugInfo {
     std::optional<double> activeKe;
     std::optional<float> activeFrac;
 
+    /* If a peripheral compartment is used, these are its transfer constants. */
+    bool hasPeripheral = false;
+    std::optional<double> k12;    // central to peripheral
+    std::optional<double> k21;    // peripheral to central
+
+    /* If nonlinear elimination is used, ke is its rate at low content. */
+    bool isNonlinear = false;
+    std::optional<double> vmax;   // maximum elimination rate in mg per second
+    std::optional<double> km;     // content at half the maximum rate
+
     /* If delayed release is used, these values are for the second dose. */
     bool isDr = false;
     std::optional<float> drFrac;
     std::optional<float> drLagtime;
+
+    /* If a dose schedule is used, dose is the amount of each repeated dose. */
+    std::optional<DoseSchedule> schedule;
 };
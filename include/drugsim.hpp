@@ -0,0 +1,71 @@
+#pragma once
+
+#include <optional>
+#include <span>
+#include <vector>
+#include "drug_info.hpp"
+#include "simulation_info.hpp"
+#include "pk_utils.hpp"
+#include "population.hpp"
+#include "combined.hpp"
+#include "steady_state.hpp"
+
+/*
+ * Non-interactive interface of libdrugsim, for programs embedding the
+ * pharmacokinetic math. Nothing here reads stdin, writes stdout or reads the
+ * clock; errors are thrown as std::invalid_argument or std::logic_error.
+ *
+ * Doses are in milligrams and times in seconds since the drug reached
+ * systemic circulation.
+*/
+namespace DrugSim
+{
+    /* Drug parameters as half-lives, converted to rate constants by makeDrug. */
+    struct DrugParams {
+        ROA_TYPE roa = ROA_TYPE_IV;
+        double dose = -1;                           // may be 0 if infusions are given
+        double halfLife = -1;                       // elimination half-life
+        std::optional<double> absorptionHalfLife;   // required unless intravenous
+        std::optional<float> vd;                    // liters, contents are mg/L if set
+        float bioavailability = 1.0f;
+        double lagtime = 0;
+        std::optional<double> ed50;                 // enables effectiveness
+        std::optional<float> excretionFrac;         // enables excreted amount
+
+        /* Prodrug, both values are required if either is used. */
+        std::optional<float> activeFrac;
+        std::optional<double> activeHalfLife;
+
+        /* Peripheral compartment, both values are required if either is used. */
+        std::optional<double> distributionHalfLife;     // central to peripheral
+        std::optional<double> redistributionHalfLife;   // peripheral to central
+
+        /* Nonlinear elimination, both values are required and halfLife is unused. */
+        std::optional<double> vmax;     // mg per second
+        std::optional<double> km;       // mg, or mg/L if vd is set
+
+        /* Delayed release (not intravenous), half of the dose if drFrac is unset. */
+        std::optional<float> drFrac;
+        std::optional<float> drLagtime;
+
+        std::optional<DoseSchedule> schedule;       // infusions are intravenous only
+    };
+
+    /* Values of evaluate(), index i of each array belongs to time point i. */
+    struct Samples {
+        std::vector<double> elapsed;
+        std::vector<double> drugContent;
+        std::vector<double> activeDrugContent;  // empty unless prodrug
+        std::vector<double> excreted;           // empty unless excretionFrac is set
+        std::vector<double> auc;                // mg*h of the amount, vd does not divide it
+        std::vector<double> effectiveness;      // empty unless ed50 is set
+
+        std::size_t size() const { return elapsed.size(); }
+    };
+
+    DrugInfo makeDrug(const DrugParams&);
+    SimulationInfo makeSimulation(const DrugParams&);
+
+    Samples evaluate(const SimulationInfo&, std::span<const double> t);
+    Samples evaluate(const SimulationInfo&, const SimulationInfo::TimeGrid&);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+#include "simulation_info.hpp"
+#include "exp_terms.hpp"
+
+/* Curve from start onwards, terms are in time since start. */
+struct CurvePiece {
+    double start = 0;
+    ExpTerms terms;
+};
+
+/* Event times computed once instead of polled every tick. */
+namespace EventSolver
+{
+    double timeAbsorbed(const DrugInfo&);
+    double timePeak(const ExpTerms&);
+    double lastTimeAbove(const std::vector<CurvePiece>&, double threshold);
+    double timePeak(const NonlinearModel&);
+    double lastTimeAbove(const NonlinearModel&, LinearModel::STATE, double threshold);
+    std::vector<CurvePiece> dosePieces(const DrugInfo&, ExpTerms);
+    std::vector<CurvePiece> drugCurve(const SimulationInfo&);
+    std::vector<CurvePiece> activeCurve(const SimulationInfo&);
+    double completionThreshold(const SimulationInfo&);
+    SimulationInfo::Events solve(const SimulationInfo&);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+/*
+ * Curve made of exponential terms, f(t) = sum of coef[k] * exp(-rate[k] * t).
+ * Single dose curves of the linear models are all of this form.
+*/
+struct ExpTerms {
+    static constexpr std::size_t MAX_TERMS = 4;
+
+    std::array<double, MAX_TERMS> coef{};
+    std::array<double, MAX_TERMS> rate{};
+    std::size_t size = 0;
+
+    void add(double c, double k) {
+        coef[size] = c;
+        rate[size] = k;
+        ++size;
+    }
+
+    double at(double t) const {
+        double sum = 0.0;
+        for (std::size_t k = 0; k < size; ++k) {
+            sum += coef[k] * std::exp(-rate[k] * t);
+        }
+        return sum;
+    }
+
+    double derivative(double t) const {
+        double sum = 0.0;
+        for (std::size_t k = 0; k < size; ++k) {
+            sum -= rate[k] * coef[k] * std::exp(-rate[k] * t);
+        }
+        return sum;
+    }
+
+    double secondDerivative(double t) const {
+        double sum = 0.0;
+        for (std::size_t k = 0; k < size; ++k) {
+            sum += rate[k] * rate[k] * coef[k] * std::exp(-rate[k] * t);
+        }
+        return sum;
+    }
+
+    // Area under the curve from 0 to t.
+    double integral(double t) const {
+        double sum = 0.0;
+        for (std::size_t k = 0; k < size; ++k) {
+            sum += coef[k] / rate[k] * (1 - std::exp(-rate[k] * t));
+        }
+        return sum;
+    }
+};
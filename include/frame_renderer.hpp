@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "render_buffer.hpp"
+
+/*
+ * Block of terminal lines redrawn as frames. Lines are staged with line(i),
+ * present() rewrites only the lines which differ from the last frame and
+ * sends the whole frame with a single write(2).
+ *
+ * Between frames the cursor rests on the last line.
+*/
+struct FrameRenderer {
+    std::vector<RenderBuffer> lines;  // staged frame
+    std::vector<RenderBuffer> shown;  // frame currently on the terminal
+    std::string frame;                // escape codes and text of one write
+    int fd;
+    bool hasShown = false;
+
+    explicit FrameRenderer(std::size_t lineCount, int fd = 1);
+
+    RenderBuffer& line(std::size_t i) { return lines[i]; }
+    bool present();
+};
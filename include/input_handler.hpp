@@ -1,6 +1,10 @@
 #pragma once
 
+#include <string>
+#include <vector>
 #include "argparser.hpp"
 #include "simulation_info.hpp"
 
-void handleInput(ArgParser& parser, SimulationInfo& info);
+// Missing values are prompted for, or thrown as errors if not interactive.
+void handleInput(ArgParser& parser, SimulationInfo& info, bool isInteractive = true);
+std::vector<std::string> getConfigNames(const ArgParser& parser);
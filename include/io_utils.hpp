@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/* Unbuffered file descriptor output used by the renderer and the exporters. */
+namespace IoUtils
+{
+    void writeAll(int fd, const char* data, std::size_t size);
+    int openOutput(const std::string& path);
+}
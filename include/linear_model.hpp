@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <span>
+#include "common.hpp"
+#include "drug_info.hpp"
+
+/*
+ * Linear compartment model dx/dt = rates * x of a single dose (amounts in mg).
+ *
+ * The eliminated states integrate the elimination of their compartment, the
+ * excreted amount and the AUC are both proportional to them. Every model is
+ * the same small matrix, only the rate entries differ.
+*/
+struct LinearModel {
+    enum STATE {
+        STATE_DEPOT,              // absorption site
+        STATE_CENTRAL,
+        STATE_PERIPHERAL,         // tissue exchanging with central
+        STATE_ACTIVE,             // active drug formed from prodrug
+        STATE_ELIMINATED,         // total eliminated from central
+        STATE_ACTIVE_ELIMINATED,  // total eliminated from active
+        STATE_TOTAL
+    };
+
+    using Vector = std::array<double, STATE_TOTAL>;
+    using Matrix = std::array<Vector, STATE_TOTAL>;
+
+    // Number of propagators, the longest time is step * 2^LEVELS.
+    static constexpr std::size_t LEVELS = 48;
+
+    // Most evenly spaced points sample advances from one state.
+    static constexpr std::size_t SAMPLE_RUN = 8;
+
+    /* Powers of the last step propagator of sample, kept between calls. */
+    struct StepCache {
+        double step = -1;
+        std::array<Matrix, SAMPLE_RUN> powers;  // exp(rates * step * (k + 1))
+    };
+
+    Matrix rates{};     // per second
+    Vector dose{};      // state right after the dose at time 0
+    Vector drDose{};    // delayed release portion, given at drLag
+    double drLag = std::numeric_limits<double>::infinity();
+
+    /*
+     * Propagators exp(rates * step * 2^k) less the identity, step is a power
+     * of two. Keeping them apart from the identity keeps slow rates exact.
+    */
+    double step = 1;
+    std::array<Matrix, LEVELS> deltas{};
+
+    Vector propagate(const Vector& x, double t) const;
+    Matrix propagator(double t) const;
+    Vector at(double t) const;
+    void sample(std::span<const double> t, std::span<Vector> out) const;
+    void sample(std::span<const double> t, std::span<Vector> out, StepCache&) const;
+};
+
+LinearModel makeLinearModel(const DrugInfo&, COMP_MODEL);
+LinearModel::Matrix matrixExp(const LinearModel::Matrix&);
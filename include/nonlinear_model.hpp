@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <span>
+#include <vector>
+#include "common.hpp"
+#include "drug_info.hpp"
+#include "linear_model.hpp"
+#include "regimen.hpp"
+
+/*
+ * Model of a drug eliminated at the saturable (Michaelis-Menten) rate
+ * vmax * c / (km + c) of its central content c, integrated by the
+ * Dormand-Prince 5(4) pair with adaptive steps (amounts in mg).
+ *
+ * States are those of LinearModel followed by the area under the central
+ * amount, the AUC no longer follows from the eliminated amount, and the rate
+ * of the infusions running. Steps end at every dose time and wherever an
+ * infusion starts or stops, so dose schedules are given as they happen.
+*/
+struct NonlinearModel {
+    static constexpr std::size_t STATE_AREA = LinearModel::STATE_TOTAL;
+    static constexpr std::size_t STATE_INFUSION = STATE_AREA + 1;  // mg per second
+    static constexpr std::size_t STATE_TOTAL = STATE_INFUSION + 1;
+
+    using Vector = std::array<double, STATE_TOTAL>;
+
+    /* One accepted step, its dense output interpolates any time within it. */
+    struct Step {
+        double t = 0;
+        double h = 0;
+        std::array<Vector, 5> cont{};
+
+        Vector at(double t) const;
+    };
+
+    /* Integration position, small enough to be kept on the stack. */
+    struct Cursor {
+        double t = -1;  // negative until started
+        double h = 0;   // next step size to try
+        Vector y{};     // state at t, after any dose given at t
+        Vector dy{};    // derivative of y
+        Step step;      // last step, ends at t
+    };
+
+    double ka = 0;              // 0 for a bolus
+    double vmax = 0;            // mg per second
+    double km = 0;              // content at half vmax (mg or mg/L)
+    double vd = 1;
+    double k12 = 0;
+    double k21 = 0;
+    double activeFrac = 0;      // 0 unless prodrug
+    double activeKe = 0;
+
+    LinearModel::STATE site = LinearModel::STATE_CENTRAL;  // doses are given here
+    double doseScale = 1;           // fraction of each dose reaching site
+    std::vector<DoseTrain> trains;  // every dose, irregular ones have no interval
+    std::vector<Infusion> infusions;
+    double absTolerance = 0;        // mg
+
+    Vector derivative(const Vector&) const;
+    double nextDoseTime(double t) const;
+    double doseAt(double t) const;
+    double rateChangeAt(double t) const;
+    double lastDoseTime() const;
+
+    Cursor start() const;
+    void advance(Cursor&) const;
+    Vector at(double t, Cursor&) const;
+    Vector at(double t) const;
+    void sample(std::span<const double> t, std::span<Vector> out) const;
+};
+
+NonlinearModel makeNonlinearModel(const DrugInfo&, COMP_MODEL);
@@ -1,35 +1,41 @@
 #pragma once
 
+#include <span>
 #include "simulation_info.hpp"
+#include "exp_terms.hpp"
 
 namespace PK
 {
     namespace OneCompartment
     {
-        double computeDrugContent(const DrugInfo&, double dose, double t);
-        double computeExcreted(const DrugInfo& drug, const double& t);
-        double computeMetaboliteContent(const DrugInfo&, const double& t);
-        double computeMetaboliteExcreted(const DrugInfo&, const double& t);
-        double computeAuc(const DrugInfo&, const double& dose, const double& t);
-        double computeMetaboliteAuc(const DrugInfo& dose, const double& t);
+        void computeDrugContent(const DrugInfo&, double dose,
+                                std::span<const double> t, std::span<double> out);
     }
 
     namespace TwoCompartment
     {
-        double computeDrugContent(const DrugInfo&, double dose, double t);
-        double computeExcreted(const DrugInfo& drug, const double& t);
-        double computeDrugContentDr(const DrugInfo&, double dose, const double& t);
-        double computeMetaboliteContent(const DrugInfo&, const double& t);
-        double computeMetaboliteExcreted(const DrugInfo&, const double& t);
-        double computeAuc(const DrugInfo&, const double& dose, const double& t);
-        double computeAucDr(const DrugInfo&, const double& dose, const double& t);
-        double computeAucMetabolite(const DrugInfo&, const double& t);
+        void computeDrugContent(const DrugInfo&, double dose,
+                                std::span<const double> t, std::span<double> out);
         bool computeIsAbsorbed(const DrugInfo&, const double& t);
         double computeTmax(const DrugInfo&);
     }
 
+    /* Disposition rates with a peripheral compartment, alpha > beta. */
+    struct HybridRates {
+        double alpha;
+        double beta;
+    };
+
+    HybridRates computeHybridRates(const DrugInfo&);
+    ExpTerms computeDrugTerms(const DrugInfo&, COMP_MODEL);
+    ExpTerms computeActiveTerms(const DrugInfo&, COMP_MODEL);
+
     double convertRateConstant(const double& k);
     double computeEffectiveness(const double& midpoint, const double& dose);
+    void computeEffectiveness(double midpoint, std::span<const double> dose,
+                              std::span<double> out);
 }
 
 double computeDrugContent(const SimulationInfo& simInfo, double elapsed);
+void computeDrugContent(const SimulationInfo& simInfo,
+                        std::span<const double> elapsed, std::span<double> out);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <span>
+#include <iterator>
+#include <vector>
+#include "simulation_info.hpp"
+
+/* Percentiles reported for each time point of a population run. */
+constexpr double POPULATION_PERCENTILES[] = {0.05, 0.50, 0.95};
+
+/*
+ * Sampled pharmacokinetic values of virtual subjects as a structure of arrays,
+ * index i of each array belongs to subject i.
+*/
+struct PopulationParams {
+    std::vector<double> ka;
+    std::vector<double> ke;
+    std::vector<double> vd;
+    std::vector<double> bioavailability;
+
+    std::size_t size() const { return ke.size(); }
+};
+
+/* Percentile bands, band[p][i] is percentile p at time point i. */
+struct PopulationBands {
+    std::vector<double> band[std::size(POPULATION_PERCENTILES)];
+};
+
+namespace Population
+{
+    PopulationParams sampleParams(const SimulationInfo&);
+    PopulationBands simulate(const SimulationInfo&, const PopulationParams&,
+                             std::span<const double> t);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include "exp_terms.hpp"
+#include "drug_info.hpp"
+
+/* Doses given every interval starting at start. */
+struct DoseTrain {
+    double start = 0;
+    double interval = 0;
+    std::size_t count = 1;
+    double dose = 0;
+};
+
+/*
+ * Dose schedule superimposed on a single dose curve (per milligram).
+ *
+ * Evenly spaced doses are summed with the geometric series, irregular doses
+ * keep the running sum of every term at each dose time. Infusions are kept
+ * the same way as changes of the infusion rate, at their start and end. Either
+ * way a sample costs the same no matter how many doses came before it.
+*/
+struct RegimenCurve {
+    ExpTerms terms;
+    std::vector<DoseTrain> trains;
+
+    /* Irregular doses sorted by time. */
+    std::vector<double> times;
+    std::vector<double> cumulativeDose;
+    std::vector<std::array<double, ExpTerms::MAX_TERMS>> running;
+
+    std::vector<Infusion> infusions;
+
+    /* Infusion rate changes sorted by time, the rate and amount infused by each. */
+    std::vector<double> rateTimes;
+    std::vector<double> infusionRate;
+    std::vector<double> infused;
+    std::vector<std::array<double, ExpTerms::MAX_TERMS>> rateRunning;
+
+    double value(double t) const;
+    double integral(double t) const;
+    double lastDoseTime() const;
+    ExpTerms termsAt(double t) const;
+
+private:
+    /* Each term's decayed dose sum at some time, and the total dose given. */
+    struct TermSums {
+        std::array<double, ExpTerms::MAX_TERMS> decayed{};
+        double given = 0;
+    };
+
+    TermSums sumsAt(double t) const;
+};
+
+RegimenCurve makeRegimenCurve(const DrugInfo&, const ExpTerms& unitCurve);
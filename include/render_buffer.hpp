@@ -0,0 +1,53 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <string_view>
+#include <system_error>
+
+/*
+ * Fixed size text buffer written in place with std::to_chars, appending never
+ * allocates. Text past the capacity is dropped.
+*/
+struct RenderBuffer {
+    static constexpr std::size_t CAPACITY = 512;
+
+    std::array<char, CAPACITY> chars;
+    std::size_t length = 0;
+
+    void clear() { length = 0; }
+    bool empty() const { return length == 0; }
+    std::size_t size() const { return length; }
+    const char* data() const { return chars.data(); }
+    std::string_view view() const { return {chars.data(), length}; }
+
+    RenderBuffer& operator+=(std::string_view text) {
+        const std::size_t n = std::min(text.size(), CAPACITY - length);
+        text.copy(chars.data() + length, n);
+        length += n;
+        return *this;
+    }
+
+    RenderBuffer& operator+=(char c) {
+        if (length < CAPACITY) chars[length++] = c;
+        return *this;
+    }
+
+    /* Append value written by std::to_chars, fmt is passed on to it. */
+    template <typename T, typename... Fmt>
+    RenderBuffer& appendChars(T value, Fmt... fmt) {
+        auto [ptr, ec] = std::to_chars(chars.data() + length,
+                                       chars.data() + CAPACITY, value, fmt...);
+        if (ec == std::errc()) length = ptr - chars.data();
+        return *this;
+    }
+
+    // Same text as std::format("{:.{}f}", value, precision).
+    RenderBuffer& appendFixed(double value, int precision) {
+        return appendChars(value, std::chars_format::fixed, precision);
+    }
+
+    bool operator==(const RenderBuffer& other) const { return view() == other.view(); }
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include "simulation_info.hpp"
+#include "render_buffer.hpp"
+
+/*
+ * Streams simulation samples to a file or pipe as CSV, or TSV if the path
+ * ends with ".tsv". Rows are buffered and written in large blocks.
+ *
+ * Columns: elapsed (seconds), drug and active drug content (mg or mg/L),
+ * excreted (mg), AUC, effectiveness and the phase labels. Values which the
+ * simulation does not have are left empty.
+*/
+struct SampleExporter {
+    static constexpr std::size_t BLOCK_SIZE = 1 << 20; // bytes per write
+
+    std::string buffer;
+    RenderBuffer row;
+    int fd = -1;
+    char delim = ',';
+
+    explicit SampleExporter(const std::string& path);
+    ~SampleExporter();
+
+    SampleExporter(const SampleExporter&) = delete;
+    SampleExporter& operator=(const SampleExporter&) = delete;
+
+    void writeHeader();
+    void write(const SimulationInfo&);
+    void flush();
+};
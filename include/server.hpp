@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+#include "argparser.hpp"
+
+/*
+ * Query server on a Unix domain socket. Every line received is a json query,
+ * or an array of queries, answered with one json line:
+ *
+ *   {"id": 1, "dose": "100 mg", "t12": "6 h", "times": [0, 3600]}
+ *
+ * Query keys are the config file keys, "times" are seconds since the drug
+ * reached systemic circulation and "id" is copied into the reply. Values given
+ * on the server's command line are defaults of every query.
+*/
+void startServer(const ArgParser& defaults, const std::string& path);
+void startClient(const std::string& path);
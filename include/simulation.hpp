@@ -1,5 +1,11 @@
 #pragma once
 
+#include <vector>
 #include "simulation_info.hpp"
 
 void startSimulation(SimulationInfo& info);
+void startBatch(SimulationInfo& info);
+void startPopulation(SimulationInfo& info);
+void startSteadyState(SimulationInfo& info);
+void startMultiSimulation(std::vector<SimulationInfo>& sims, bool showCombined);
+void startCombinedBatch(std::vector<SimulationInfo>& sims);
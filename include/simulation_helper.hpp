@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include "pch.hpp"
 #include "simulation_info.hpp"
 
@@ -10,11 +11,18 @@ namespace SimHelper
     void validateInit(SimulationInfo&);
     double getMinDisplayDose(int prec);
     void updateCurrentDoses(SimulationInfo&);
+    void updateModelDoses(SimulationInfo&, const LinearModel::Vector&);
+    void updateModelDoses(SimulationInfo&, const NonlinearModel::Vector&);
+    void updateRegimenDoses(SimulationInfo&);
     void checkMaxAchieved(SimulationInfo&);
     void checkTmaxState(SimulationInfo&);
+    void checkDrReleased(SimulationInfo&);
     void useFixedPrecision(SimulationInfo&);
     void checkFullyAbsorbed(SimulationInfo&);
-    bool isMinDose(SimulationInfo&);
+    bool isComplete(const SimulationInfo&);
+    void updateTick(SimulationInfo&, bool updateText = true);
     void updateCache(SimulationInfo&);
+    std::string_view getPhaseLabel(const SimulationInfo&);
+    std::string_view getDrPhaseLabel(const SimulationInfo&);
     void updateOutput(std::string& out, const SimulationInfo&, const std::string& unit);
 }
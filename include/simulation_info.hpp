@@ -1,9 +1,15 @@
 #pragma once
 
+#include <array>
 #include <chrono>
+#include <cstdint>
 #include <optional>
 #include <string>
 #include "drug_info.hpp"
+#include "regimen.hpp"
+#include "linear_model.hpp"
+#include "nonlinear_model.hpp"
+#include "render_buffer.hpp"
 #include "common.hpp"
 
 struct SimulationInfo {
@@ -13,6 +19,9 @@ struct SimulationInfo {
     int precision = 0;
     std::optional<int> sigfigs;
     double minDoseAllowed = 0;
+    double tickRate = 20;           // display updates per second
+    CLOCK_MODE clockMode = CLOCK_REAL;
+    double clockSpeed = 1;          // clock seconds per real second (or per second of ticks)
 
     bool is12HrFormat = false;      // display time in 12 hour format?
     bool isAucEnabled = false;
@@ -22,15 +31,65 @@ struct SimulationInfo {
     bool baseUnitsEnabled = false;
     bool ed50Enabled = false;
     bool displayExcreted = false;
+    bool isAllocReportEnabled = false; // report heap allocations of the loop?
+    bool isProfileEnabled = false;     // report time spent in each tick stage?
+    bool isSteadyStateEnabled = false; // report the steady state instead of simulating?
+
+    std::optional<std::string> exportPath; // samples are streamed here, see SampleExporter
+
+    // AUC is computed to be displayed or exported.
+    bool needsAuc() const { return isAucEnabled || exportPath.has_value(); }
 
     DrugInfo drugInfo;
 
     COMP_MODEL compModel = ONE_COMP_MODEL;
 
+    /* Event times in seconds since systemic circulation, see EventSolver. */
+    struct Events {
+        double tmax = 0;        // drug reaches peak concentration
+        double drTmax = 0;      // delayed release portion reaches peak
+        double absorbed = 0;    // fraction absorbed reaches ABSORBED_THRESHOLD
+        double completion = 0;  // drug stays below the minimum displayed dose
+    } events;
+
+    /* Single dose model, built by validateInit. */
+    LinearModel model;
+
+    /* Model of saturable elimination, replaces model and the schedule curves. */
+    std::optional<NonlinearModel> nonlinear;
+
+    /* Dose schedule curves, built by validateInit if a schedule is used. */
+    std::optional<RegimenCurve> regimen;
+    std::optional<RegimenCurve> activeRegimen;
+
+    /* Time grid (in seconds) evaluated by batch mode. */
+    struct TimeGrid {
+        double start = 0;
+        double end = 0;
+        double step = 0;
+
+        // Number of samples in the grid, including both ends.
+        std::size_t size() const {
+            return static_cast<std::size_t>((end - start) / step + 1e-9) + 1;
+        }
+
+        double at(std::size_t i) const { return start + i * step; }
+    };
+    std::optional<TimeGrid> batch;
+
+    /* Virtual subjects simulated by population mode. */
+    struct Population {
+        std::size_t subjects = 0;
+        std::array<double, 4> cv{}; // coefficient of variation of ka, ke, vd, F
+        std::uint64_t seed = 0;
+    };
+    std::optional<Population> population;
+
     /* Dynamic simulation info. */
     struct State {
         /* Time tracking */
         double elapsed = 0.0; // time since simulation start (in seconds)
+        NonlinearModel::Cursor cursor; // integration position of nonlinear model
 
         int prec = 0; // current dose unit precision
         DOSE_UNIT doseUnit = DOSE_UNIT_MG;
@@ -65,9 +124,9 @@ struct SimulationInfo {
 
     /* Cache information. */
     struct Cache {
-        /* Outputs */
-        std::string output; // this will be printed
-        std::string altOutput;
+        /* Outputs, rebuilt every tick without allocating */
+        RenderBuffer output; // this will be printed
+        RenderBuffer altOutput;
 
         /* Unit strings */
         std::string doseUnitStr;
@@ -89,6 +148,7 @@ const std::string_view absorptionPhaseLabel{"absorption"};
 const std::string_view eliminationPhaseLabel{"elimination"};
 const std::string_view elPhaseAbsorbingLabel{"elimination, abs"};
 const std::string_view lagPhaseLabel{"lag"};
+const std::string_view infusionPhaseLabel{"infusion"};
 
 /*
  * String view of abbreviations --
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "common.hpp"
+#include "drug_info.hpp"
+#include "exp_terms.hpp"
+
+/*
+ * Steady state of a dose repeated every interval without end, contents are in
+ * mg (or mg/L if vd is set) and times in seconds. Every past dose is summed by
+ * the geometric series of each term, so nothing is simulated.
+*/
+struct SteadyState {
+    double interval = 0;
+    double max = 0;           // Css,max
+    double tmax = 0;          // time of Css,max after a dose
+    double min = 0;           // Css,min
+    double tmin = 0;          // time of Css,min after a dose
+    double average = 0;       // Css,avg, area of one interval over its length
+    double accumulation = 0;  // area of one interval at steady state over the first
+    double timeTo90 = 0;      // time after the first dose the average reaches 90%
+};
+
+SteadyState computeSteadyState(const DrugInfo&, const ExpTerms& unitCurve, double interval);
+SteadyState computeSteadyState(const DrugInfo&, COMP_MODEL, double interval);
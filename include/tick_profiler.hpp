@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+/*
+ * Log-linear latency histogram in the style of HdrHistogram. Values below
+ * 2^SUB_BITS nanoseconds have their own bucket, above that every power of two
+ * is split into 2^(SUB_BITS-1) buckets, so recorded values keep about 3%
+ * precision from nanoseconds to hours. Recording never allocates.
+*/
+struct LatencyHistogram {
+    static constexpr int SUB_BITS = 5;
+    static constexpr std::size_t SUB_COUNT = 1 << SUB_BITS;
+    static constexpr std::size_t BUCKET_COUNT = (64 - SUB_BITS + 2) * (SUB_COUNT / 2);
+
+    std::array<std::uint64_t, BUCKET_COUNT> counts{};
+    std::uint64_t total = 0;
+    std::uint64_t max = 0;
+
+    void record(std::uint64_t ns);
+    std::uint64_t percentile(double q) const;
+
+    static std::size_t bucketOf(std::uint64_t ns);
+    static std::uint64_t highestInBucket(std::size_t bucket);
+};
+
+/* Stages of a simulation tick timed by TickProfiler. */
+enum PROFILE_STAGE {
+    PROFILE_UPDATE_DOSES,
+    PROFILE_CHECK_MAX,
+    PROFILE_FIXED_PRECISION,
+    PROFILE_UPDATE_CACHE,
+    PROFILE_DISPLAY,
+    PROFILE_SLEEP,
+    PROFILE_TICK,           // every stage of the tick except sleep
+    PROFILE_STAGE_COUNT,
+};
+
+/*
+ * Times the stages of the simulation loop, mark(stage) records the time since
+ * the previous mark or restart. Does nothing unless enabled.
+*/
+struct TickProfiler {
+    using clock = std::chrono::steady_clock;
+
+    bool isEnabled;
+    std::array<LatencyHistogram, PROFILE_STAGE_COUNT> stages;
+    clock::time_point last;
+    clock::time_point tickStart;
+
+    explicit TickProfiler(bool isEnabled) : isEnabled(isEnabled) {}
+
+    void startTick() {
+        if (isEnabled) tickStart = last = clock::now();
+    }
+
+    void restart() {
+        if (isEnabled) last = clock::now();
+    }
+
+    void mark(PROFILE_STAGE stage) {
+        if (!isEnabled) return;
+        const auto now = clock::now();
+        stages[stage].record(std::chrono::nanoseconds(now - last).count());
+        last = now;
+    }
+
+    // Record the work of the tick, called before sleeping.
+    void endTick() {
+        if (!isEnabled) return;
+        last = clock::now();
+        stages[PROFILE_TICK].record(std::chrono::nanoseconds(last - tickStart).count());
+    }
+
+    void report(std::ostream&) const;
+};
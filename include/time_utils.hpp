@@ -1,7 +1,10 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include "common.hpp"
 
 std::chrono::duration<double> getEpoch();
 std::chrono::duration<double> getTimeEpoch(std::string timeStr);
@@ -9,6 +12,42 @@ std::chrono::duration<double> getDateEpoch(std::string datetimeStr);
 std::string getTimeAndDateString(std::chrono::duration<double> epoch=
                                  std::chrono::duration<double>(-1),
                                  bool is12HrFormat=false);
-std::chrono::duration<double> hhmmToSeconds(std::string hhmm);
+std::chrono::duration<double> hhmmToSeconds(std::string_view hhmm);
 void swapTimeFormat(std::string& text);
-void sleepFor(int ms);
+
+/*
+ * Ticks at a fixed rate on absolute deadlines, so time spent between ticks
+ * does not shift the period. Deadlines missed entirely are skipped.
+*/
+struct TickScheduler {
+    using clock = std::chrono::steady_clock;
+
+    clock::duration period;
+    clock::time_point next;
+
+    explicit TickScheduler(double rateHz);
+    void wait();
+};
+
+/*
+ * Time of a live simulation, ticking at rateHz. A scaled clock runs speed
+ * times faster than real time, a virtual clock advances speed / rateHz
+ * seconds per tick without sleeping so every run is the same.
+*/
+struct SimClock {
+    using seconds = std::chrono::duration<double>;
+
+    CLOCK_MODE mode;
+    double speed;
+    seconds step;                   // clock time per tick of a virtual clock
+    seconds origin;                 // system time when the clock was started
+    TickScheduler::clock::time_point realOrigin;
+    TickScheduler ticker;
+    std::uint64_t ticks = 0;
+
+    SimClock(CLOCK_MODE mode, double speed, double rateHz);
+
+    seconds elapsed() const;
+    double since(seconds epoch) const { return (origin - epoch).count() + elapsed().count(); }
+    void wait();
+};
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+
+/* Array math used by the dense (time grid) kernels. */
+namespace VecMath
+{
+    /*
+     * out[i] = exp(x[i]) for n values, x and out may be the same array.
+     *
+     * @note: uses AVX-512 or AVX2 when the cpu supports it, std::exp otherwise
+    */
+    void exp(const double* x, double* out, std::size_t n);
+
+    /* Name of the exp kernel selected for this cpu, e.g. "avx2". */
+    const char* expKernelName();
+}
@@ -0,0 +1,38 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "alloc_counter.hpp"
+
+namespace
+{
+    std::atomic<std::size_t> allocations{0};
+}
+
+std::size_t AllocCounter::count()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+
+/*
+ * Replacements of the global allocation functions, the array and nothrow
+ * forms call these by default.
+*/
+void* operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
@@ -7,7 +7,21 @@
 using std::string;
 using std::size_t;
 
-void ArgParser::displayHelp()
+namespace
+{
+    // Every arg sorted by flag, for help and lookup by flag.
+    constexpr auto argsByFlag = [] {
+        auto sorted = globalArgs;
+        std::sort(sorted.begin(), sorted.end(), [](auto a, auto b) { return a->flag < b->flag; });
+        return sorted;
+    }();
+
+    static_assert(std::adjacent_find(argsByFlag.begin(), argsByFlag.end(), [](auto a, auto b) {
+        return a->flag == b->flag;
+    }) == argsByFlag.end(), "flags must be unique");
+}
+
+void ArgParser::displayHelp() const
 {
     std::stringstream stream;
     stream << std::left;
@@ -16,14 +30,18 @@ void ArgParser::displayHelp()
 
     const int spaces = 32;
 
-    for (const auto& it : args)
+    for (const Args::Metadata* meta : argsByFlag)
     {
-        string line = "  " + it.meta.flag;
+        if (!args[meta->id].meta)
+            continue;
+
+        string line = "  ";
+        line += meta->flag;
 
-        if (it.meta.flag.length() > 2 && !it.meta.param.empty())
+        if (meta->flag.length() > 2 && !meta->param.empty())
             line += '=';
 
-        line += it.meta.param;
+        line += meta->param;
 
         if (line.length() >= spaces) {
             line += '\n';
@@ -32,7 +50,7 @@ void ArgParser::displayHelp()
             line += string(spaces - line.length(), ' ');
         }
 
-        line += it.meta.desc;
+        line += meta->desc;
 
         stream << line << std::endl;
     }
@@ -40,58 +58,44 @@ void ArgParser::displayHelp()
     std::cout << stream.str() << std::endl;
 }
 
-void ArgParser::addArg(const Args::Metadata meta)
+void ArgParser::addArg(const Args::Metadata& meta)
 {
-    args.push_back({.meta=meta});
+    args[meta.id].meta = &meta;
 }
 
-/* Sort args in alphabetical order. */
-void ArgParser::sortArgs()
+/* Added arg with flag, null if there is none. */
+ArgParser::Arg* ArgParser::findArg(std::string_view flag)
 {
-    std::sort(args.begin(), args.end(), [&](auto& a, auto& b) {
-            return a.meta.flag < b.meta.flag;
-    });
-}
+    auto it = std::lower_bound(argsByFlag.begin(), argsByFlag.end(), flag,
+                               [](auto meta, std::string_view f) { return meta->flag < f; });
 
-/* Check if arg has been added to parser. */
-bool ArgParser::argExists(std::string name) const
-{
-    for (const auto& it : args) {
-        if (it.meta.flag == name) {
-            return true;
-        }
-    }
-    return false;
+    if (it == argsByFlag.end() || (*it)->flag != flag)
+        return nullptr;
+
+    Arg& arg = args[(*it)->id];
+    return arg.meta ? &arg : nullptr;
 }
 
-ArgParser::Arg& ArgParser::getArg(const Args::Metadata meta)
+ArgParser::Arg& ArgParser::getArg(const Args::Metadata& meta)
 {
-    for (auto& it : args) {
-        if (meta.flag == it.meta.flag)
-            return it;
-    }
-
-    throw std::invalid_argument("arg '" + meta.flag + "' does not exist");
+    return const_cast<Arg&>(std::as_const(*this).getArg(meta));
 }
 
-ArgParser::Arg& ArgParser::getArgByFlag(std::string flag)
+const ArgParser::Arg& ArgParser::getArg(const Args::Metadata& meta) const
 {
-    for (auto& it : args) {
-        if (it.meta.flag == flag)
-            return it;
+    const Arg& arg = args[meta.id];
+
+    if (!arg.meta) {
+        throw std::invalid_argument("arg '" + string(meta.flag) + "' does not exist");
     }
 
-    throw std::invalid_argument("no arg with name '" + flag + "' exist");
+    return arg;
 }
 
 /* Check if arg was used. */
-bool ArgParser::isArgUsed(Args::Metadata arg) const
+bool ArgParser::isArgUsed(const Args::Metadata& meta) const
 {
-    for (const auto& it : args) {
-        if (it.meta.flag == arg.flag && it.value.has_value())
-            return true;
-    }
-    return false;
+    return args[meta.id].value.has_value();
 }
 
 void ArgParser::parse(int argc, char** argv)
@@ -99,19 +103,20 @@ void ArgParser::parse(int argc, char** argv)
     if (argc == 1)
         return;
 
-    auto setVal = [&](const Args::Metadata meta, const std::string& val) {
-        for (auto& it : args) { if (it.meta.flag == meta.flag) it.value = val; }
+    auto setVal = [&](Arg& arg, const std::string& val) {
+        if (arg.meta->isRepeatable && arg.value.has_value())
+            arg.value.value() += ',' + val;
+        else
+            arg.value = val;
     };
 
-    const Arg* currentArg = nullptr;
-
     for (int i = 1; i < argc; ++i)
     {
-        std::string val = argv[i];
+        const std::string_view val = argv[i];
         bool isLast = i + 1 == argc;
         bool nextExists = i + 2 == argc;
-        bool isNextArg = nextExists && argExists(argv[i + 1]);
-        bool isShort = val.at(0) == '-' && val.at(1) != '-' && val.length() > 2;
+        bool isNextArg = nextExists && findArg(argv[i + 1]);
+        bool isShort = val.length() > 2 && val.at(0) == '-' && val.at(1) != '-';
 
         if (val == "--help" || val == "-h") {
             displayHelp();
@@ -119,33 +124,27 @@ void ArgParser::parse(int argc, char** argv)
         }
 
         size_t flagEndPos = isShort ? 1 : val.find_first_of('=') - 1;
-        string flag = val.substr(0, flagEndPos + 1);
+        Arg* arg = findArg(val.substr(0, flagEndPos + 1));
 
-        bool exists = argExists(flag);
-        if (exists) {
-            currentArg = &getArgByFlag(flag);
-        }
+        if (!arg)
+            continue;
 
-        bool hasParam = exists && !currentArg->meta.param.empty();
+        bool hasParam = !arg->meta->param.empty();
 
-        if (exists && isShort) {
-            setVal(currentArg->meta, val.substr(2));
-            continue;
+        if (isShort) {
+            setVal(*arg, string(val.substr(2)));
         }
-        else if (exists && val.find('=') != string::npos) {
-            setVal(currentArg->meta, val.substr(flagEndPos + 2));
-            continue;
+        else if (val.find('=') != string::npos) {
+            setVal(*arg, string(val.substr(flagEndPos + 2)));
         }
-
-        if (exists && hasParam && (isNextArg || isLast)) {
-            throw std::invalid_argument("flag '" + val + "' requires an argument");
+        else if (hasParam && (isNextArg || isLast)) {
+            throw std::invalid_argument("flag '" + string(val) + "' requires an argument");
         }
-
-        if (exists && !hasParam) {
-            setVal(currentArg->meta, "true");
+        else if (!hasParam) {
+            setVal(*arg, "true");
         }
-        else if (exists && hasParam) {
-            setVal(currentArg->meta, argv[i + 1]);
+        else {
+            setVal(*arg, argv[i + 1]);
         }
     }
 }
@@ -0,0 +1,337 @@
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "pch.hpp"
+#include "column_file.hpp"
+#include "io_utils.hpp"
+#include "render_buffer.hpp"
+
+using std::size_t;
+
+static_assert(sizeof(ColumnFileHeader) % alignof(double) == 0);
+static_assert(sizeof(ColumnInfo) % alignof(double) == 0);
+
+namespace
+{
+    const double UNUSED = std::numeric_limits<double>::quiet_NaN();
+
+    [[noreturn]] void throwSystemError(const std::string& what)
+    {
+        throw std::runtime_error(what + ": " + std::strerror(errno));
+    }
+
+    /* Copy text into a fixed size field, always null terminated. */
+    template <size_t N>
+    void copyField(char (&field)[N], std::string_view text)
+    {
+        std::memset(field, 0, N);
+        text.copy(field, std::min(text.size(), N - 1));
+    }
+
+    std::string_view fieldView(const char* field, size_t size)
+    {
+        return {field, strnlen(field, size)};
+    }
+
+    ColumnFileHeader makeHeader(const SimulationInfo& sim, size_t columns, size_t rows)
+    {
+        const auto& drug = sim.drugInfo;
+
+        ColumnFileHeader header{};
+        std::memcpy(header.magic, COLUMN_FILE_MAGIC, sizeof(header.magic));
+        header.version = COLUMN_FILE_VERSION;
+        header.byteOrderMark = COLUMN_FILE_BYTE_ORDER;
+        header.rowCount = rows;
+        header.columnCount = columns;
+        header.compModel = sim.compModel;
+        header.roa = drug.roa;
+        header.subjects = sim.population.has_value() ? sim.population->subjects : 0;
+
+        header.flags = (drug.isProdrug ? COLUMN_FILE_PRODRUG : 0) |
+                       (drug.isDr ? COLUMN_FILE_DR : 0) |
+                       (sim.baseUnitsEnabled ? COLUMN_FILE_VOLUME : 0);
+
+        header.dose = drug.dose;
+        header.ka = drug.ka > 0 ? drug.ka : UNUSED;
+        header.ke = drug.ke;
+        header.vd = drug.vd;
+        header.bioavailability = drug.bioavailability;
+        header.lagtime = drug.lagtime;
+        header.ed50 = sim.ed50Enabled ? drug.ed50 : UNUSED;
+        header.excretionFrac = sim.displayExcreted ? drug.excretionFrac : UNUSED;
+        header.activeKe = drug.activeKe.value_or(UNUSED);
+        header.activeFrac = drug.activeFrac.has_value() ? *drug.activeFrac : UNUSED;
+        header.drFrac = drug.drFrac.has_value() ? *drug.drFrac : UNUSED;
+        header.drLagtime = drug.drLagtime.has_value() ? *drug.drLagtime : UNUSED;
+
+        return header;
+    }
+}
+
+/* Column files are written for paths ending with ".bin". */
+bool isColumnFilePath(const std::string& path)
+{
+    return path.ends_with(".bin");
+}
+
+ColumnFileWriter::ColumnFileWriter(const std::string& path, const SimulationInfo& sim,
+                                   std::span<const ColumnSpec> columns, size_t rows)
+    : rowCount(rows)
+{
+    // The destructor does not run if the constructor throws.
+    try {
+        open(path, sim, columns);
+    }
+    catch (...) {
+        release();
+        throw;
+    }
+}
+
+void ColumnFileWriter::open(const std::string& path, const SimulationInfo& sim,
+                            std::span<const ColumnSpec> columns)
+{
+    const size_t rows = rowCount;
+    const size_t dataStart = sizeof(ColumnFileHeader) + columns.size() * sizeof(ColumnInfo);
+    mapSize = dataStart + columns.size() * rows * sizeof(double);
+
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throwSystemError("cannot open '" + path + "'");
+    }
+
+    if (::ftruncate(fd, mapSize) != 0) {
+        throwSystemError("cannot resize '" + path + "'");
+    }
+
+    void* ptr = ::mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        throwSystemError("cannot map '" + path + "'");
+    }
+    map = static_cast<char*>(ptr);
+
+    const ColumnFileHeader header = makeHeader(sim, columns.size(), rows);
+    std::memcpy(map, &header, sizeof(header));
+
+    for (size_t i = 0; i < columns.size(); ++i)
+    {
+        ColumnInfo info{};
+        copyField(info.name, columns[i].name);
+        copyField(info.unit, columns[i].unit);
+        info.offset = dataStart + i * rows * sizeof(double);
+
+        std::memcpy(map + sizeof(header) + i * sizeof(ColumnInfo), &info, sizeof(info));
+    }
+}
+
+ColumnFileWriter::~ColumnFileWriter()
+{
+    release();
+}
+
+/* Unmap and close whatever is open, errors are ignored. */
+void ColumnFileWriter::release()
+{
+    if (map != nullptr) ::munmap(map, mapSize);
+    if (fd >= 0) ::close(fd);
+    map = nullptr;
+    fd = -1;
+}
+
+std::span<double> ColumnFileWriter::column(size_t i)
+{
+    const size_t offset = sizeof(ColumnFileHeader) + i * sizeof(ColumnInfo);
+
+    ColumnInfo info;
+    std::memcpy(&info, map + offset, sizeof(info));
+
+    return {reinterpret_cast<double*>(map + info.offset), rowCount};
+}
+
+/* Unmap and close the file, errors are reported unlike the destructor. */
+void ColumnFileWriter::close()
+{
+    if (::munmap(map, mapSize) != 0) {
+        throwSystemError("cannot unmap column file");
+    }
+    map = nullptr;
+
+    if (::close(fd) != 0) {
+        throwSystemError("cannot close column file");
+    }
+    fd = -1;
+}
+
+ColumnFileReader::ColumnFileReader(const std::string& path)
+{
+    // The destructor does not run if the constructor throws.
+    try {
+        open(path);
+    }
+    catch (...) {
+        release();
+        throw;
+    }
+}
+
+void ColumnFileReader::open(const std::string& path)
+{
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throwSystemError("cannot open '" + path + "'");
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        throwSystemError("cannot stat '" + path + "'");
+    }
+    mapSize = st.st_size;
+
+    if (mapSize < sizeof(ColumnFileHeader)) {
+        throw std::invalid_argument("'" + path + "' is not a column file");
+    }
+
+    void* ptr = ::mmap(nullptr, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        throwSystemError("cannot map '" + path + "'");
+    }
+    map = static_cast<const char*>(ptr);
+
+    const auto& head = header();
+
+    if (std::memcmp(head.magic, COLUMN_FILE_MAGIC, sizeof(head.magic)) != 0) {
+        throw std::invalid_argument("'" + path + "' is not a column file");
+    }
+    else if (head.version != COLUMN_FILE_VERSION) {
+        throw std::invalid_argument("unsupported column file version");
+    }
+    else if (head.byteOrderMark != COLUMN_FILE_BYTE_ORDER) {
+        throw std::invalid_argument("column file was written with another byte order");
+    }
+
+    /* Every column must lie inside the file, counts are checked before sizes overflow. */
+    if (head.columnCount > mapSize / sizeof(ColumnInfo) ||
+        head.rowCount > mapSize / sizeof(double))
+    {
+        throw std::invalid_argument("column file is truncated");
+    }
+
+    const size_t infoEnd = sizeof(ColumnFileHeader) + head.columnCount * sizeof(ColumnInfo);
+    const size_t columnSize = head.rowCount * sizeof(double);
+
+    if (infoEnd > mapSize) {
+        throw std::invalid_argument("column file is truncated");
+    }
+
+    for (const auto& info : columns()) {
+        if (info.offset % alignof(double) != 0 || info.offset < infoEnd ||
+            info.offset > mapSize || mapSize - info.offset < columnSize)
+        {
+            throw std::invalid_argument("column file is truncated");
+        }
+    }
+}
+
+ColumnFileReader::~ColumnFileReader()
+{
+    release();
+}
+
+void ColumnFileReader::release()
+{
+    if (map != nullptr) ::munmap(const_cast<char*>(map), mapSize);
+    if (fd >= 0) ::close(fd);
+    map = nullptr;
+    fd = -1;
+}
+
+const ColumnFileHeader& ColumnFileReader::header() const
+{
+    return *reinterpret_cast<const ColumnFileHeader*>(map);
+}
+
+std::span<const ColumnInfo> ColumnFileReader::columns() const
+{
+    const auto* first = reinterpret_cast<const ColumnInfo*>(map + sizeof(ColumnFileHeader));
+    return {first, header().columnCount};
+}
+
+std::span<const double> ColumnFileReader::column(size_t i) const
+{
+    const auto& info = columns()[i];
+    return {reinterpret_cast<const double*>(map + info.offset), header().rowCount};
+}
+
+/* Index of the column with the given name. */
+std::optional<size_t> ColumnFileReader::find(std::string_view name) const
+{
+    const auto cols = columns();
+
+    for (size_t i = 0; i < cols.size(); ++i) {
+        if (fieldView(cols[i].name, sizeof(cols[i].name)) == name)
+            return i;
+    }
+
+    return std::nullopt;
+}
+
+/*
+ * Print the header of a column file as comments followed by its rows as TSV,
+ * values are read straight from the memory map.
+*/
+void dumpColumnFile(const std::string& path)
+{
+    ColumnFileReader reader(path);
+
+    const auto& head = reader.header();
+    const auto cols = reader.columns();
+
+    std::cout << std::format("# rows: {}\n# subjects: {}\n", head.rowCount, head.subjects);
+    std::cout << std::format(
+        "# dose: {} ka: {} ke: {} vd: {} F: {} lagtime: {} ed50: {}\n",
+        head.dose, head.ka, head.ke, head.vd, head.bioavailability, head.lagtime, head.ed50
+    );
+    std::cout << std::format(
+        "# fe: {} active ke: {} active frac: {} dr frac: {} dr lagtime: {}\n",
+        head.excretionFrac, head.activeKe, head.activeFrac, head.drFrac, head.drLagtime
+    );
+
+    std::cout << '#';
+    for (const auto& info : cols) {
+        std::cout << ' ' << fieldView(info.name, sizeof(info.name)) << " ("
+                  << fieldView(info.unit, sizeof(info.unit)) << ')';
+    }
+    std::cout << '\n' << std::flush;
+
+    std::vector<std::span<const double>> data;
+    for (size_t i = 0; i < cols.size(); ++i) {
+        data.push_back(reader.column(i));
+    }
+
+    std::string buffer;
+    buffer.reserve((1 << 16) + RenderBuffer::CAPACITY);
+    RenderBuffer row;
+
+    for (size_t r = 0; r < head.rowCount; ++r)
+    {
+        row.clear();
+        for (size_t c = 0; c < data.size(); ++c) {
+            if (c) row += '\t';
+            row.appendChars(data[c][r]);
+        }
+        row += '\n';
+
+        buffer += row.view();
+
+        if (buffer.size() >= (1 << 16)) {
+            IoUtils::writeAll(STDOUT_FILENO, buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    }
+
+    IoUtils::writeAll(STDOUT_FILENO, buffer.data(), buffer.size());
+}
@@ -0,0 +1,208 @@
+#include <cmath>
+#include <algorithm>
+#include "pch.hpp"
+#include "combined.hpp"
+#include "event_solver.hpp"
+#include "vec_math.hpp"
+#include "pk_utils.hpp"
+
+using std::size_t;
+
+namespace
+{
+    // Time points handled per pass, temporaries stay on stack.
+    constexpr size_t BLOCK = 256;
+
+    /*
+     * Active moiety of one simulation. Scheduled doses are read from the
+     * regimen until the closed form pieces take over at pieces.front().start,
+     * a nonlinear model is integrated along the time points instead.
+    */
+    struct Contribution {
+        double offset = 0;
+        std::vector<CurvePiece> pieces;
+        const RegimenCurve* regimen = nullptr;
+        double regimenEnd = 0;
+        const NonlinearModel* nonlinear = nullptr;
+        NonlinearModel::Cursor cursor;
+        LinearModel::STATE state = LinearModel::STATE_CENTRAL;
+    };
+
+    Contribution makeContribution(const SimulationInfo& sim, double offset)
+    {
+        const bool isProdrug = sim.drugInfo.isProdrug;
+
+        Contribution part;
+        part.offset = offset;
+        part.pieces = isProdrug ? EventSolver::activeCurve(sim) :
+                                  EventSolver::drugCurve(sim);
+
+        if (sim.nonlinear.has_value()) {
+            part.nonlinear = &sim.nonlinear.value();
+            part.state = isProdrug ? LinearModel::STATE_ACTIVE : LinearModel::STATE_CENTRAL;
+        }
+
+        const auto& regimen = isProdrug ? sim.activeRegimen : sim.regimen;
+
+        if (regimen.has_value()) {
+            part.regimen = &regimen.value();
+            part.regimenEnd = part.pieces.empty() ? INFINITY : part.pieces.front().start;
+        }
+
+        return part;
+    }
+
+    /* out[i] += active content at t[i], x and scale hold n values of scratch. */
+    void addContribution(Contribution& part, const double* t, double* out,
+                         size_t n, double* x, double* scale)
+    {
+        if (part.nonlinear != nullptr)
+        {
+            const auto& model = *part.nonlinear;
+            const double unit = part.state == LinearModel::STATE_CENTRAL ? 1.0 / model.vd : 1.0;
+
+            for (size_t i = 0; i < n; ++i) {
+                out[i] += model.at(t[i] - part.offset, part.cursor)[part.state] * unit;
+            }
+            return;
+        }
+
+        for (size_t p = 0; p < part.pieces.size(); ++p)
+        {
+            const auto& piece = part.pieces[p];
+            const double end = p + 1 < part.pieces.size() ?
+                               part.pieces[p + 1].start : INFINITY;
+
+            for (size_t k = 0; k < piece.terms.size; ++k)
+            {
+                const double coef = piece.terms.coef[k];
+                const double rate = piece.terms.rate[k];
+
+                /* Points outside the piece are evaluated at its start and dropped. */
+                for (size_t i = 0; i < n; ++i) {
+                    const double local = t[i] - part.offset;
+                    const bool inside = local >= piece.start && local < end;
+
+                    x[i] = -rate * (inside ? local - piece.start : 0.0);
+                    scale[i] = inside ? coef : 0.0;
+                }
+
+                VecMath::exp(x, x, n);
+
+                for (size_t i = 0; i < n; ++i) {
+                    out[i] += scale[i] * x[i];
+                }
+            }
+        }
+
+        if (part.regimen == nullptr)
+            return;
+
+        for (size_t i = 0; i < n; ++i) {
+            const double local = t[i] - part.offset;
+            if (local >= 0 && local < part.regimenEnd)
+                out[i] += part.regimen->value(local);
+        }
+    }
+}
+
+/*
+ * Time from the earliest administration until each simulation's drug reaches
+ * systemic circulation, simulations must be validated first.
+*/
+std::vector<double> Combined::startOffsets(const std::vector<SimulationInfo>& sims)
+{
+    std::vector<double> offsets;
+
+    if (sims.empty())
+        return offsets;
+
+    const auto first = std::min_element(sims.begin(), sims.end(), [](auto& a, auto& b) {
+        return a.epoch < b.epoch;
+    })->epoch;
+
+    for (const auto& sim : sims) {
+        offsets.push_back((sim.epoch - first).count() + sim.drugInfo.lagtime);
+    }
+
+    return offsets;
+}
+
+/* Unit of the summed content, every simulation must use the same one. */
+std::string_view Combined::sharedUnit(const std::vector<SimulationInfo>& sims)
+{
+    for (const auto& sim : sims) {
+        if (sim.baseUnitsEnabled != sims.front().baseUnitsEnabled)
+            throw std::invalid_argument("combined simulations must all use volume or none");
+    }
+
+    return !sims.empty() && sims.front().baseUnitsEnabled ? MGL_STR : MG_STR;
+}
+
+/* ED50 of the shared active moiety, 0 if no simulation uses ED50. */
+double Combined::sharedEd50(const std::vector<SimulationInfo>& sims)
+{
+    double ed50 = 0;
+
+    for (const auto& sim : sims)
+    {
+        if (!sim.ed50Enabled)
+            continue;
+        else if (ed50 > 0 && sim.drugInfo.ed50 != ed50)
+            throw std::invalid_argument("combined simulations must share the same ed50");
+
+        ed50 = sim.drugInfo.ed50;
+    }
+
+    return ed50;
+}
+
+/*
+ * Summed active content of every simulation at each time point, and the
+ * effectiveness of that sum if effectiveness is not empty. Both are computed
+ * block by block in a single pass over the time points.
+*/
+void Combined::evaluate(const std::vector<SimulationInfo>& sims,
+                        std::span<const double> t, std::span<double> content,
+                        std::span<double> effectiveness)
+{
+    if (content.size() < t.size()) {
+        throw std::invalid_argument("output span is smaller than time span");
+    }
+
+    const bool hasEffect = !effectiveness.empty();
+    const double ed50 = hasEffect ? sharedEd50(sims) : 0;
+
+    if (hasEffect && effectiveness.size() < t.size()) {
+        throw std::invalid_argument("output span is smaller than time span");
+    }
+    else if (hasEffect && ed50 <= 0) {
+        throw std::invalid_argument("combined effectiveness requires ed50");
+    }
+
+    const auto offsets = startOffsets(sims);
+
+    std::vector<Contribution> parts;
+    for (size_t i = 0; i < sims.size(); ++i) {
+        parts.push_back(makeContribution(sims[i], offsets[i]));
+    }
+
+    double x[BLOCK];
+    double scale[BLOCK];
+
+    for (size_t pos = 0; pos < t.size(); pos += BLOCK)
+    {
+        const size_t n = std::min(BLOCK, t.size() - pos);
+        double* out = content.data() + pos;
+
+        std::fill(out, out + n, 0.0);
+
+        for (auto& part : parts) {
+            addContribution(part, t.data() + pos, out, n, x, scale);
+        }
+
+        if (hasEffect) {
+            PK::computeEffectiveness(ed50, {out, n}, effectiveness.subspan(pos, n));
+        }
+    }
+}
@@ -1,82 +1,149 @@
-#include <regex>
+#include <charconv>
 #include <cassert>
 #include "pch.hpp"
 #include "convert_utils.hpp"
 #include "common.hpp"
 
-using std::stof;
-using std::stod;
 using std::floor;
 using std::fmod;
 using std::string;
+using std::string_view;
 using namespace UnitConverter;
 
-std::pair<double, std::optional<std::string>> parseNumberUnitInput(std::string);
-
-const std::regex NUMBER_UNIT_INPUT_REGEX{"^(\\d*?\\.?\\d+?)(?:\\s?([a-zA-Z/]+?))?$"};
-const std::regex reDoseInput{
-    "^((?:\\d*?\\.)?\\d+)(?:\\s*?([a-z]+)(?:/?([a-z]+)?))?$",
-    std::regex::icase
-};
-
-// Detects n/d numbers.
-const std::regex numberFracRe{"((?:\\d*?\\.)?\\d+)/((?:\\d*?\\.)?\\d+)"};
+std::pair<double, std::optional<string_view>> parseNumberUnitInput(string_view);
 
 /*
- * Return multiplier to convert specified unit to default dose unit,
- * e.g. how many (default units) per specified unit.
+ * Input is scanned by hand in a single pass, numbers are read with
+ * std::from_chars. Accepted syntax:
  *
- * @note default dose units are mg for mass and mL for volume
+ *   number:      \d*\.?\d+, optionally a fraction "number/number"
+ *   time input:  number, optionally followed by one space and [a-zA-Z/]+
+ *   dose input:  number, optionally followed by spaces, a unit and "/base"
 */
-double Dose::toDefaultFactor(const DOSE_UNIT& unit)
+namespace
 {
-    switch (unit) {
-        case DOSE_UNIT_NANOGRAM:
-            return 1e-6;
-        case DOSE_UNIT_MICROGRAM:
-            return 1e-3;
-        case DOSE_UNIT_GRAM:
-        case DOSE_UNIT_L:
-            return 1e+3;
-        default:
-            return 1;
+    bool isDigit(char c) { return c >= '0' && c <= '9'; }
+    bool isAlpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+
+    // Characters of \s in the C locale.
+    bool isSpace(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+    std::size_t countDigits(string_view text, std::size_t pos)
+    {
+        std::size_t n = 0;
+        while (pos + n < text.size() && isDigit(text[pos + n])) ++n;
+        return n;
     }
-}
 
-double Dose::toMgPerLiterFactor(const DOSE_UNIT& unit, const BASE_UNIT& base)
-{
-    return toDefaultFactor(unit) / Base::toLitersFactor(base);
-}
+    /* Length of the number starting at pos, 0 if there is none. */
+    std::size_t matchNumber(string_view text, std::size_t pos)
+    {
+        const std::size_t whole = countDigits(text, pos);
+        const std::size_t dot = pos + whole;
 
-double Base::toLitersFactor(const BASE_UNIT& base)
-{
-    switch (base) {
-        case BASE_UNIT_ML:
-            return 1e-3;
-        default:
-            return 1;
+        if (dot < text.size() && text[dot] == '.') {
+            const std::size_t frac = countDigits(text, dot + 1);
+            if (frac > 0) return whole + 1 + frac;
+        }
+
+        return whole;
     }
-}
 
-/* Return multiplier to convert specified unit to seconds. */
-double Time::toSecondsFactor(const TIME_UNIT& unit)
-{
-    switch (unit) {
-        case TIME_UNIT_MS:
-            return 0.001;
-        case TIME_UNIT_MINUTE:
-            return 60;
-        case TIME_UNIT_HOUR:
-            return 3600;
-        case TIME_UNIT_DAY:
-            return 86400;
-        default:
-            return 1;
+    /* Length of the number at pos if it is directly followed by c, otherwise 0. */
+    std::size_t matchNumberBefore(string_view text, std::size_t pos, char c)
+    {
+        const std::size_t n = matchNumber(text, pos);
+        return n > 0 && pos + n < text.size() && text[pos + n] == c ? n : 0;
+    }
+
+    /* Value of a matched number, out of range values throw like std::stod. */
+    template <typename T>
+    T toNumber(string_view text)
+    {
+        T value = 0;
+        auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+
+        if (ec == std::errc::result_out_of_range) {
+            throw std::out_of_range("number is out of range: " + string(text));
+        }
+        assert(ec == std::errc() && ptr == text.data() + text.size());
+
+        return value;
+    }
+
+    /* Number at the start of text, den is 0 unless it is a fraction. */
+    struct LeadingNumber {
+        std::size_t num = 0;
+        std::size_t den = 0;
+
+        std::size_t length() const { return den > 0 ? num + 1 + den : num; }
+    };
+
+    LeadingNumber matchLeadingNumber(string_view text)
+    {
+        LeadingNumber number;
+        number.num = matchNumber(text, 0);
+
+        if (number.num > 0 && number.num < text.size() && text[number.num] == '/') {
+            number.den = matchNumber(text, number.num + 1);
+        }
+
+        return number;
+    }
+
+    /* Value of a matched number, a fraction is divided and may not be finite. */
+    double toValue(string_view text, const LeadingNumber& number)
+    {
+        const double value = toNumber<double>(text.substr(0, number.num));
+
+        if (number.den == 0)
+            return value;
+
+        return value / toNumber<double>(text.substr(number.num + 1, number.den));
+    }
+
+    /*
+     * Replace every "number" followed by suffix in text with format(number),
+     * matches are found from left to right without overlapping.
+    */
+    template <typename Format>
+    void replaceNumbers(string& text, char suffix, bool hasSecondNumber, Format format)
+    {
+        string out;
+        std::size_t copied = 0;
+        char chars[512];
+
+        for (std::size_t pos = 0; pos < text.size();)
+        {
+            const std::size_t num = matchNumberBefore(text, pos, suffix);
+            const std::size_t tail = num > 0 && hasSecondNumber ?
+                                     matchNumber(text, pos + num + 1) : 0;
+
+            if (num == 0 || (hasSecondNumber && tail == 0)) {
+                ++pos;
+                continue;
+            }
+
+            const string_view first(text.data() + pos, num);
+            const string_view second(text.data() + pos + num + 1, tail);
+            const char* end = format(chars, chars + sizeof(chars), first, second);
+
+            out.append(text, copied, pos - copied);
+            out.append(chars, end - chars);
+
+            pos += num + 1 + tail;
+            copied = pos;
+        }
+
+        if (copied > 0) {
+            out.append(text, copied);
+            text = std::move(out);
+        }
     }
 }
 
 /* Time and unit input string to seconds, e.g. "1 h" = 3600.0 */
-double timeInputToSeconds(std::string text)
+double timeInputToSeconds(string_view text)
 {
     auto input = parseNumberUnitInput(text);
 
@@ -91,30 +158,58 @@ double timeInputToSeconds(std::string text)
 }
 
 /* Return parsed dose input. */
-ParsedDose parseDoseInput(std::string text)
+ParsedDose parseDoseInput(string_view text)
 {
     ParsedDose result;
 
-    // Replace fractions with values.
-    setFractionsToDecimal(text);
+    const LeadingNumber number = matchLeadingNumber(text);
+    if (number.num == 0) {
+        throw std::invalid_argument("invalid dose input");
+    }
 
-    std::smatch match;
+    std::size_t pos = number.length();
+    while (pos < text.size() && isSpace(text[pos])) ++pos;
 
-    if (!std::regex_search(text, match, reDoseInput)) {
+    if (pos == text.size() && pos != number.length()) {
         throw std::invalid_argument("invalid dose input");
     }
 
-    result.value = stod(match[1].str());
+    auto readLetters = [&]() {
+        const std::size_t start = pos;
+        while (pos < text.size() && isAlpha(text[pos])) ++pos;
+        return text.substr(start, pos - start);
+    };
 
     // Set dose unit.
-    if (match[2].matched) {
-        result.doseUnit = stringToUnit<DOSE_UNIT>(match[2].str());
-        result.useDoseUnit = true;
+    const string_view doseUnit = readLetters();
+    if (doseUnit.empty() && pos != text.size()) {
+        throw std::invalid_argument("invalid dose input");
+    }
+
+    // Set denominator unit, the slash may be given without one.
+    string_view baseUnit;
+    if (pos < text.size() && text[pos] == '/') {
+        ++pos;
+        baseUnit = readLetters();
     }
 
-    // Set denominator unit.
-    if (match[3].matched) {
-        result.baseUnit = stringToUnit<BASE_UNIT>(match[3].str());
+    if (pos != text.size()) {
+        throw std::invalid_argument("invalid dose input");
+    }
+
+    result.value = toValue(text, number);
+    if (!std::isfinite(result.value)) {
+        throw std::invalid_argument("invalid dose input");
+    }
+
+    if (doseUnit.empty())
+        return result;
+
+    result.doseUnit = stringToUnit<DOSE_UNIT>(doseUnit);
+    result.useDoseUnit = true;
+
+    if (!baseUnit.empty()) {
+        result.baseUnit = stringToUnit<BASE_UNIT>(baseUnit);
         result.useBaseUnit = true;
     }
 
@@ -122,46 +217,47 @@ ParsedDose parseDoseInput(std::string text)
 }
 
 /*
- * Return pair <number, unit string> based on input.
+ * Return pair <number, unit string> based on input, the unit refers to text.
 */
-std::pair<double, std::optional<std::string>> parseNumberUnitInput(std::string text)
+std::pair<double, std::optional<string_view>> parseNumberUnitInput(string_view text)
 {
-    std::smatch match;
+    const LeadingNumber number = matchLeadingNumber(text);
+    string_view unit = text.substr(number.length());
 
-    setFractionsToDecimal(text);
+    if (!unit.empty() && isSpace(unit.front())) {
+        unit.remove_prefix(1);
+    }
 
-    if (std::regex_search(text, match, NUMBER_UNIT_INPUT_REGEX)) {
-        double num = stod(match[1].str());
-        if (!match[2].matched)
-            return std::make_pair(num, std::nullopt);
-        return std::make_pair(num, match[2].str());
+    const bool isUnit = std::all_of(unit.begin(), unit.end(), [](char c) {
+        return isAlpha(c) || c == '/';
+    });
+
+    // A space must be followed by a unit.
+    if (number.num == 0 || !isUnit || (unit.empty() && text.size() != number.length())) {
+        throw std::runtime_error("invalid number input");
     }
 
-    throw std::runtime_error("invalid number input");
+    const double value = toValue(text, number);
+    if (!std::isfinite(value)) {
+        throw std::runtime_error("invalid number input");
+    }
+
+    if (unit.empty())
+        return std::make_pair(value, std::nullopt);
+    return std::make_pair(value, unit);
 }
 
 /*
  * Changes all fractions to their values, e.g. 1/2 => 0.5
+ *
+ * @note: values are written like std::to_string, e.g. "0.500000"
 */
 void setFractionsToDecimal(string& text)
 {
-    std::vector<std::smatch> matches;
-
-    for (std::sregex_iterator it(text.begin(), text.end(), numberFracRe), end;
-         it != end; ++it)
-    {
-        matches.push_back(*it);
-    }
-
-    for (auto mIt = matches.rbegin(); mIt != matches.rend(); ++mIt) {
-        const std::smatch& m = *mIt;
-
-        double num = stod(m[1].str());
-        double den = stod(m[2].str());
-        double val = num / den;
-
-        text.replace(m.position(), m.length(), std::to_string(val));
-    }
+    replaceNumbers(text, '/', true, [](char* first, char* last, string_view num, string_view den) {
+        const double val = toNumber<double>(num) / toNumber<double>(den);
+        return std::to_chars(first, last, val, std::chars_format::fixed, 6).ptr;
+    });
 }
 
 /*
@@ -169,31 +265,19 @@ void setFractionsToDecimal(string& text)
 */
 void setPercentagesToDecimal(string& text)
 {
-    std::vector<std::smatch> matches;
-    std::regex re{R"(((?:\d*\.)?\d+)%)"};
-
-    for (std::sregex_iterator it(text.begin(), text.end(), re), end;
-         it != end; ++it)
-    {
-        matches.push_back(*it);
-    }
-
-    for (auto it = matches.rbegin(); it != matches.rend(); ++it) {
-        const std::smatch& m = *it;
-
-        float val = stof(m[1].str()) * 0.01f;
-
-        std::ostringstream oss;
-        oss << std::setprecision(6) << std::noshowpoint << val;
-
-        text.replace(m.position(), m.length(), oss.str());
-    }
+    replaceNumbers(text, '%', false, [](char* first, char* last, string_view num, string_view) {
+        const float val = toNumber<float>(num) * 0.01f;
+        return std::to_chars(first, last, static_cast<double>(val),
+                             std::chars_format::general, 6).ptr;
+    });
 }
 
-string formatSigFigs(const double& value, const int& sigfigs)
+/* Append value rounded to sigfigs significant figures. */
+void appendSigFigs(RenderBuffer& out, double value, int sigfigs)
 {
     if (value == 0.0) {
-        return std::format("{:.{}f}", 0.0, sigfigs - 1);
+        out.appendFixed(0.0, sigfigs - 1);
+        return;
     }
 
     int exp = static_cast<int>(std::floor(std::log10(std::fabs(value))));
@@ -201,20 +285,27 @@ string formatSigFigs(const double& value, const int& sigfigs)
     double rounded = std::round(value / scale) * scale;
     int prec = std::max(sigfigs - exp - 1, 0);
 
-    return std::format("{:.{}f}", rounded, prec);
+    out.appendFixed(rounded, prec);
+}
+
+string formatSigFigs(const double& value, const int& sigfigs)
+{
+    RenderBuffer buffer;
+    appendSigFigs(buffer, value, sigfigs);
+    return string(buffer.view());
 }
 
 /*
- * Convert seconds to readable time.
+ * Append seconds as readable time.
 */
-std::string formatSeconds(float s)
+void appendSeconds(RenderBuffer& out, float s)
 {
     if (s < 1) {
-        return std::format("{} ms", floor(s * 1e+3f));
+        out.appendChars(floor(s * 1e+3f));
+        out += " ms";
+        return;
     }
 
-    std::stringstream stream;
-
     int clockHours = s / 3600;
     int clockMinutes = fmod(s, 3600) / 60;
     int clockSeconds = fmod(s, 60);
@@ -224,10 +315,11 @@ std::string formatSeconds(float s)
      * @param unit: time unit label to be made plural if needed
      * @param com: should add ", " to end of string?
     */
-    auto appendFn = [&](const int &n, std::string unit, bool com=false) {
-        if (n != 1) unit.append("s");
-        if (com) unit.append(", ");
-        stream << n << unit;
+    auto appendFn = [&](const int &n, std::string_view unit, bool com=false) {
+        out.appendChars(n);
+        out += unit;
+        if (n != 1) out += 's';
+        if (com) out += ", ";
     };
 
     if (clockHours > 0) {
@@ -237,8 +329,16 @@ std::string formatSeconds(float s)
         appendFn(clockMinutes, " minute", true);
     }
     appendFn(clockSeconds, " second");
+}
 
-    return stream.str();
+/*
+ * Convert seconds to readable time.
+*/
+std::string formatSeconds(float s)
+{
+    RenderBuffer buffer;
+    appendSeconds(buffer, s);
+    return string(buffer.view());
 }
 
 /* Return true if the specified dose unit is a volume unit. */
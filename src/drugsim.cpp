@@ -0,0 +1,183 @@
+#include "pch.hpp"
+#include "drugsim.hpp"
+#include "simulation_helper.hpp"
+
+using PK::convertRateConstant;
+
+namespace
+{
+    bool hasInfusions(const DrugSim::DrugParams& params)
+    {
+        return params.schedule.has_value() && !params.schedule->infusions.empty();
+    }
+}
+
+/* Convert and validate drug parameters the same way the CLI input does. */
+DrugInfo DrugSim::makeDrug(const DrugParams& params)
+{
+    if (params.roa < 0 || params.roa >= std::size(roaCompModels)) {
+        throw std::invalid_argument("invalid route of administration");
+    }
+    else if (params.dose < 0 || (params.dose == 0 && !hasInfusions(params))) {
+        throw std::invalid_argument("dose must be greater than 0");
+    }
+    else if (params.halfLife <= 0 && !params.vmax.has_value()) {
+        throw std::invalid_argument("half-life must be greater than 0");
+    }
+    else if (params.vd.has_value() && *params.vd <= 0) {
+        throw std::invalid_argument("volume of distribution must be greater than 0");
+    }
+
+    DrugInfo drug;
+    drug.roa = params.roa;
+    drug.dose = params.dose;
+    drug.ke = convertRateConstant(params.halfLife);
+    drug.vd = params.vd.value_or(1);
+    drug.bioavailability = params.bioavailability;
+    drug.lagtime = params.lagtime;
+    drug.schedule = params.schedule;
+
+    if (params.roa != ROA_TYPE_IV) {
+        if (params.absorptionHalfLife.value_or(0) <= 0) {
+            throw std::invalid_argument("absorption half-life is required unless intravenous");
+        }
+        drug.ka = convertRateConstant(*params.absorptionHalfLife);
+    }
+
+    if (hasInfusions(params))
+    {
+        if (params.roa != ROA_TYPE_IV) {
+            throw std::logic_error("infusions must be intravenous");
+        }
+
+        for (const auto& it : params.schedule->infusions) {
+            if (it.start < 0 || it.duration <= 0 || it.rate <= 0)
+                throw std::invalid_argument("infusion requires a duration and rate greater than 0");
+        }
+    }
+
+    if (params.ed50.has_value()) {
+        drug.ed50 = *params.ed50;
+    }
+    if (params.excretionFrac.has_value()) {
+        drug.excretionFrac = *params.excretionFrac;
+    }
+
+    if (params.activeFrac.has_value() || params.activeHalfLife.has_value()) {
+        if (!params.activeFrac.has_value() || params.activeHalfLife.value_or(0) <= 0) {
+            throw std::invalid_argument("prodrug requires active fraction and half-life");
+        }
+        drug.isProdrug = true;
+        drug.activeFrac = params.activeFrac;
+        drug.activeKe = convertRateConstant(*params.activeHalfLife);
+    }
+
+    if (params.distributionHalfLife.has_value() || params.redistributionHalfLife.has_value()) {
+        if (params.distributionHalfLife.value_or(0) <= 0 ||
+            params.redistributionHalfLife.value_or(0) <= 0) {
+            throw std::invalid_argument("peripheral compartment requires both half-lives");
+        }
+        drug.hasPeripheral = true;
+        drug.k12 = convertRateConstant(*params.distributionHalfLife);
+        drug.k21 = convertRateConstant(*params.redistributionHalfLife);
+    }
+
+    if (params.vmax.has_value() || params.km.has_value()) {
+        if (params.vmax.value_or(0) <= 0 || params.km.value_or(0) <= 0) {
+            throw std::invalid_argument("nonlinear elimination requires vmax and km");
+        }
+        drug.isNonlinear = true;
+        drug.vmax = params.vmax;
+        drug.km = params.km;
+        drug.ke = *drug.vmax / (*drug.km * drug.vd);
+    }
+
+    if (params.drFrac.has_value() || params.drLagtime.has_value()) {
+        if (roaCompModels[params.roa] != TWO_COMP_MODEL) {
+            throw std::logic_error("delayed release must be a two compartment model");
+        }
+        else if (!params.drLagtime.has_value()) {
+            throw std::invalid_argument("delayed release requires a lagtime");
+        }
+        drug.isDr = true;
+        drug.drFrac = params.drFrac.value_or(0.5f);
+        drug.drLagtime = params.drLagtime;
+    }
+
+    return drug;
+}
+
+/* Simulation ready to be evaluated, validated like every CLI mode. */
+SimulationInfo DrugSim::makeSimulation(const DrugParams& params)
+{
+    SimulationInfo sim;
+    sim.drugInfo = makeDrug(params);
+    sim.compModel = roaCompModels[params.roa];
+    sim.baseUnitsEnabled = params.vd.has_value();
+    sim.ed50Enabled = params.ed50.has_value();
+    sim.displayExcreted = params.excretionFrac.has_value();
+    sim.isAucEnabled = true;
+
+    SimHelper::validateInit(sim);
+
+    return sim;
+}
+
+/*
+ * Evaluate the simulation at every time point. The simulation is copied, so
+ * one simulation may be evaluated from several threads at once.
+*/
+DrugSim::Samples DrugSim::evaluate(const SimulationInfo& sim, std::span<const double> t)
+{
+    SimulationInfo tick = sim;
+    tick.isAucEnabled = true;
+
+    const auto& drug = tick.drugInfo;
+    const auto& state = tick.state;
+    const std::size_t n = t.size();
+
+    Samples out;
+    out.elapsed.assign(t.begin(), t.end());
+    out.drugContent.resize(n);
+    out.auc.resize(n);
+    if (drug.isProdrug) out.activeDrugContent.resize(n);
+    if (tick.displayExcreted) out.excreted.resize(n);
+    if (tick.ed50Enabled) out.effectiveness.resize(n);
+
+    /* Single dose states are sampled at once, one product per grid point. */
+    std::vector<LinearModel::Vector> states;
+    if (!tick.regimen.has_value() && !tick.nonlinear.has_value()) {
+        states.resize(n);
+        tick.model.sample(t, states);
+    }
+
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        tick.state.elapsed = t[i];
+        if (states.empty()) SimHelper::updateCurrentDoses(tick);
+        else SimHelper::updateModelDoses(tick, states[i]);
+
+        out.drugContent[i] = state.drugContent;
+        out.auc[i] = state.auc;
+        if (drug.isProdrug) out.activeDrugContent[i] = *state.activeDrugContent;
+        if (tick.displayExcreted) out.excreted[i] = state.excreted;
+        if (tick.ed50Enabled) out.effectiveness[i] = state.effectiveness;
+    }
+
+    return out;
+}
+
+DrugSim::Samples DrugSim::evaluate(const SimulationInfo& sim,
+                                   const SimulationInfo::TimeGrid& grid)
+{
+    if (grid.step <= 0 || grid.end < grid.start) {
+        throw std::invalid_argument("time grid requires start <= end and step > 0");
+    }
+
+    std::vector<double> times(grid.size());
+    for (std::size_t i = 0; i < times.size(); ++i) {
+        times[i] = grid.at(i);
+    }
+
+    return evaluate(sim, times);
+}
@@ -0,0 +1,392 @@
+#include <algorithm>
+#include <limits>
+#include "pch.hpp"
+#include "event_solver.hpp"
+#include "pk_utils.hpp"
+#include "convert_utils.hpp"
+
+using std::exp;
+using std::log;
+using std::size_t;
+
+namespace
+{
+    constexpr int MAX_ITERATIONS = 200;
+    constexpr double TIME_TOLERANCE = 1e-9; // relative, in seconds
+
+    // Steps of a nonlinear model searched for an event before giving up.
+    constexpr int MAX_STEPS = 1000000;
+
+    /*
+     * Grid the derivative's sign is checked on, from well before the time
+     * scale of the fastest term to long after the slowest one has decayed.
+    */
+    constexpr double GRID_START = 1.0 / 16;
+    constexpr double GRID_END = 64;
+    constexpr double GRID_STEP = 1.25;
+
+    /*
+     * Root of f within [lo, hi] where f(lo) and f(hi) differ in sign, newton
+     * steps are used while they stay inside the bracket, bisection otherwise.
+    */
+    template <typename Fn, typename DerivFn>
+    double findRoot(Fn f, DerivFn df, double lo, double hi)
+    {
+        const bool isRising = f(lo) < 0;
+        double x = 0.5 * (lo + hi);
+
+        for (int i = 0; i < MAX_ITERATIONS; ++i)
+        {
+            const double fx = f(x);
+            if (fx == 0)
+                return x;
+
+            if ((fx < 0) == isRising) lo = x;
+            else hi = x;
+
+            if (hi - lo <= TIME_TOLERANCE * std::max(1.0, x))
+                break;
+
+            const double dfx = df(x);
+            const double newton = dfx != 0 ? x - fx / dfx : lo;
+
+            x = (newton > lo && newton < hi) ? newton : 0.5 * (lo + hi);
+        }
+
+        return x;
+    }
+
+    /* Root of f within [lo, hi] where f(lo) > 0 >= f(hi), by bisection. */
+    template <typename Fn>
+    double bisect(Fn f, double lo, double hi)
+    {
+        for (int i = 0; i < MAX_ITERATIONS && hi - lo > TIME_TOLERANCE * std::max(1.0, hi); ++i)
+        {
+            const double x = 0.5 * (lo + hi);
+            if (f(x) > 0) lo = x;
+            else hi = x;
+        }
+        return 0.5 * (lo + hi);
+    }
+
+    /* Time scale of the slowest term, used for the first bracket guess. */
+    double slowestTime(const ExpTerms& terms)
+    {
+        double rate = terms.rate[0];
+        for (size_t k = 1; k < terms.size; ++k) {
+            rate = std::min(rate, terms.rate[k]);
+        }
+        return 1.0 / rate;
+    }
+
+    double fastestTime(const ExpTerms& terms)
+    {
+        double rate = terms.rate[0];
+        for (size_t k = 1; k < terms.size; ++k) {
+            rate = std::max(rate, terms.rate[k]);
+        }
+        return 1.0 / rate;
+    }
+
+    /*
+     * Times the curve turns from rising to falling, in order. The slope at 0
+     * is not trusted alone, active drug formed from a prodrug starts with a
+     * slope of 0 that rounding may leave slightly negative, and a piece may
+     * fall before it rises, e.g. when a delayed portion is released.
+    */
+    std::vector<double> peakTimes(const ExpTerms& terms)
+    {
+        std::vector<double> peaks;
+
+        auto df = [&](double t) { return terms.derivative(t); };
+        auto d2f = [&](double t) { return terms.secondDerivative(t); };
+
+        const double end = GRID_END * slowestTime(terms);
+        double lo = 0;
+
+        for (double hi = GRID_START * fastestTime(terms); lo < end; hi *= GRID_STEP)
+        {
+            if (df(lo) > 0 && df(hi) <= 0)
+                peaks.push_back(findRoot(df, d2f, lo, hi));
+            lo = hi;
+        }
+
+        // Still rising once every term should have decayed.
+        if (df(lo) > 0)
+            peaks.push_back(std::numeric_limits<double>::infinity());
+
+        return peaks;
+    }
+
+    /* Double hi from a guess until pred(hi) is true, returns infinity if never. */
+    template <typename Pred>
+    double bracketUntil(Pred pred, double lo, double guess)
+    {
+        double hi = lo + guess;
+        for (int i = 0; i < MAX_ITERATIONS; ++i) {
+            if (pred(hi))
+                return hi;
+            hi = lo + (hi - lo) * 2;
+        }
+        return std::numeric_limits<double>::infinity();
+    }
+
+    /*
+     * Time (since the piece start) the curve falls to threshold after its
+     * peak, the curve must be above threshold at peak.
+    */
+    double timeFallsTo(const ExpTerms& terms, double peak, double threshold)
+    {
+        // One term is a plain exponential decay.
+        if (terms.size == 1) {
+            return log(terms.coef[0] / threshold) / terms.rate[0];
+        }
+
+        auto f = [&](double t) { return terms.at(t) - threshold; };
+        auto df = [&](double t) { return terms.derivative(t); };
+
+        double hi = bracketUntil([&](double t) { return f(t) <= 0; },
+                                 peak, slowestTime(terms));
+
+        if (std::isinf(hi))
+            return hi;
+
+        return findRoot(f, df, peak, hi);
+    }
+}
+
+/*
+ * Single dose curve per milligram (terms) scaled by the dose, the immediate
+ * portion alone until the delayed portion is released.
+*/
+std::vector<CurvePiece> EventSolver::dosePieces(const DrugInfo& drug, ExpTerms terms)
+{
+    if (!drug.isDr) {
+        for (size_t k = 0; k < terms.size; ++k) terms.coef[k] *= drug.dose;
+        return {{0, terms}};
+    }
+
+    const double lag = drug.drLagtime.value();
+    const double drFrac = drug.drFrac.value();
+
+    ExpTerms ir = terms;
+    ExpTerms both = terms;
+
+    for (size_t k = 0; k < terms.size; ++k) {
+        ir.coef[k] *= drug.dose * (1 - drFrac);
+        both.coef[k] *= drug.dose * ((1 - drFrac) * exp(-terms.rate[k] * lag) + drFrac);
+    }
+
+    return {{0, ir}, {lag, both}};
+}
+
+/* Time for the absorbed fraction to reach ABSORBED_THRESHOLD. */
+double EventSolver::timeAbsorbed(const DrugInfo& drug)
+{
+    if (drug.roa == ROA_TYPE_IV || drug.ka <= 0)
+        return 0;
+
+    return -log(1 - ABSORBED_THRESHOLD) / drug.ka;
+}
+
+/* Time the curve reaches its highest value, 0 if it only decreases. */
+double EventSolver::timePeak(const ExpTerms& terms)
+{
+    if (terms.size == 0)
+        return 0;
+
+    double best = 0;
+
+    for (const double peak : peakTimes(terms)) {
+        if (std::isinf(peak) || terms.at(peak) > terms.at(best))
+            best = peak;
+    }
+
+    return best;
+}
+
+/*
+ * Return the last time the piecewise curve is above threshold, 0 if it never
+ * is. Each piece lasts until the next one starts, it falls below threshold
+ * after its start or one of its peaks, the latest one above threshold.
+*/
+double EventSolver::lastTimeAbove(const std::vector<CurvePiece>& pieces,
+                                  double threshold)
+{
+    for (size_t i = pieces.size(); i-- > 0;)
+    {
+        const auto& piece = pieces[i];
+        const double duration = i + 1 < pieces.size() ?
+                                pieces[i + 1].start - piece.start :
+                                std::numeric_limits<double>::infinity();
+
+        if (piece.terms.size == 0)
+            continue;
+
+        std::vector<double> falls{0.0};
+        for (const double peak : peakTimes(piece.terms)) {
+            falls.push_back(std::min(peak, duration));
+        }
+
+        for (size_t j = falls.size(); j-- > 0;)
+        {
+            if (piece.terms.at(falls[j]) <= threshold)
+                continue;
+
+            // Still above when the next piece starts, i.e. the curve jumps down.
+            if (piece.terms.at(duration) > threshold)
+                return piece.start + duration;
+
+            return piece.start + timeFallsTo(piece.terms, falls[j], threshold);
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Time the central content of the nonlinear model first peaks, 0 if it only
+ * decreases. The peak is found in the first step the content falls over.
+*/
+double EventSolver::timePeak(const NonlinearModel& model)
+{
+    constexpr auto CENTRAL = LinearModel::STATE_CENTRAL;
+
+    auto c = model.start();
+    if (c.dy[CENTRAL] <= 0)
+        return 0;
+
+    auto df = [&](double t) { return model.derivative(c.step.at(t))[CENTRAL]; };
+
+    for (int i = 0; i < MAX_STEPS; ++i)
+    {
+        model.advance(c);
+
+        // Derivative before any dose given at the end of the step.
+        if (df(c.t) <= 0)
+            return bisect(df, c.step.t, c.t);
+    }
+
+    return std::numeric_limits<double>::infinity();
+}
+
+/*
+ * Return the last time the content of a state of the nonlinear model is
+ * above threshold, i.e. it falls below after the final dose.
+*/
+double EventSolver::lastTimeAbove(const NonlinearModel& model, LinearModel::STATE state,
+                                  double threshold)
+{
+    const double last = model.lastDoseTime();
+    if (std::isinf(last))
+        return last;
+
+    const double scale = state == LinearModel::STATE_CENTRAL ? 1.0 / model.vd : 1.0;
+    auto f = [&](const NonlinearModel::Vector& y) { return y[state] * scale - threshold; };
+
+    auto c = model.start();
+
+    for (int i = 0; i < MAX_STEPS; ++i)
+    {
+        if (c.t >= last && f(c.y) <= 0 && c.dy[state] < 0) {
+            if (f(c.step.at(c.step.t)) <= 0)
+                return c.step.t;
+            return bisect([&](double t) { return f(c.step.at(t)); }, c.step.t, c.t);
+        }
+
+        model.advance(c);
+    }
+
+    return std::numeric_limits<double>::infinity();
+}
+
+/* Curve of the displayed drug (prodrug if used) as pieces. */
+std::vector<CurvePiece> EventSolver::drugCurve(const SimulationInfo& sim)
+{
+    if (sim.nonlinear.has_value())
+        return {};
+
+    // Only the curve after the final dose matters for a schedule.
+    if (sim.regimen.has_value()) {
+        const double last = sim.regimen->lastDoseTime();
+        if (std::isinf(last)) return {};
+        return {{last, sim.regimen->termsAt(last)}};
+    }
+
+    return dosePieces(sim.drugInfo, PK::computeDrugTerms(sim.drugInfo, sim.compModel));
+}
+
+/* Curve of the active drug from prodrug as pieces. */
+std::vector<CurvePiece> EventSolver::activeCurve(const SimulationInfo& sim)
+{
+    if (sim.nonlinear.has_value())
+        return {};
+
+    if (sim.activeRegimen.has_value()) {
+        const double last = sim.activeRegimen->lastDoseTime();
+        if (std::isinf(last)) return {};
+        return {{last, sim.activeRegimen->termsAt(last)}};
+    }
+
+    return dosePieces(sim.drugInfo, PK::computeActiveTerms(sim.drugInfo, sim.compModel));
+}
+
+/*
+ * Drug content (in mg or mg/L) below which the simulation is complete.
+ *
+ * @note: the display threshold in mg does not change when units are stepped
+ * down by useFixedPrecision, both the unit and precision change by 1e3
+*/
+double EventSolver::completionThreshold(const SimulationInfo& sim)
+{
+    const auto& state = sim.state;
+    double displayMg = state.minDisplayDose *
+                       UnitConverter::Dose::toDefaultFactor(state.doseUnit);
+
+    return std::max(sim.minDoseAllowed, displayMg);
+}
+
+/* Compute every event time of the simulation. */
+SimulationInfo::Events EventSolver::solve(const SimulationInfo& sim)
+{
+    const auto& drug = sim.drugInfo;
+
+    SimulationInfo::Events events;
+
+    events.tmax = drug.tmax;
+    events.drTmax = drug.isDr ? drug.tmax + drug.drLagtime.value() : 0;
+    events.absorbed = timeAbsorbed(drug);
+
+    const double threshold = completionThreshold(sim);
+
+    if (sim.nonlinear.has_value()) {
+        const auto& model = *sim.nonlinear;
+
+        events.completion = std::max(events.absorbed, lastTimeAbove(
+            model, LinearModel::STATE_CENTRAL, threshold
+        ));
+        if (drug.isProdrug) {
+            events.completion = std::max(events.completion, lastTimeAbove(
+                model, LinearModel::STATE_ACTIVE, threshold
+            ));
+        }
+
+        return events;
+    }
+
+    double completion = std::max(events.absorbed,
+                                 lastTimeAbove(drugCurve(sim), threshold));
+
+    if (drug.isProdrug) {
+        completion = std::max(completion, lastTimeAbove(activeCurve(sim), threshold));
+    }
+
+    // Not complete while scheduled doses are still to come.
+    if (sim.regimen.has_value()) {
+        completion = std::max(completion, sim.regimen->lastDoseTime());
+    }
+
+    events.completion = completion;
+
+    return events;
+}
@@ -0,0 +1,86 @@
+#include <charconv>
+#include "pch.hpp"
+#include "frame_renderer.hpp"
+#include "io_utils.hpp"
+#include "common.hpp"
+
+namespace
+{
+    /* Append cursor movement of n lines, code is 'A' (up) or 'B' (down). */
+    void appendCursorMove(std::string& out, std::size_t n, char code)
+    {
+        char digits[24];
+        auto res = std::to_chars(digits, digits + sizeof(digits), n);
+
+        out += "\x1b[";
+        out.append(digits, res.ptr);
+        out += code;
+    }
+}
+
+FrameRenderer::FrameRenderer(std::size_t lineCount, int fd)
+    : lines(lineCount), shown(lineCount), fd(fd)
+{
+    if (lineCount == 0) {
+        throw std::invalid_argument("frame requires at least one line");
+    }
+
+    // Worst case is every line rewritten with a cursor move in front.
+    frame.reserve(lineCount * (RenderBuffer::CAPACITY + ANSI_CLEAR.size() + 16));
+}
+
+/*
+ * Draw the staged lines, returns false without writing anything if no line
+ * changed since the last frame.
+*/
+bool FrameRenderer::present()
+{
+    const std::size_t last = lines.size() - 1;
+
+    frame.clear();
+
+    if (!hasShown)
+    {
+        for (std::size_t i = 0; i < lines.size(); ++i) {
+            frame += '\r';
+            frame += ANSI_CLEAR;
+            frame += lines[i].view();
+            if (i != last) frame += '\n';
+        }
+        hasShown = true;
+    }
+    else
+    {
+        std::size_t row = last;
+
+        for (std::size_t i = 0; i < lines.size(); ++i)
+        {
+            if (lines[i] == shown[i])
+                continue;
+
+            // Every line starts with a carriage return, the column never matters.
+            if (i < row) appendCursorMove(frame, row - i, 'A');
+            else if (i > row) appendCursorMove(frame, i - row, 'B');
+            row = i;
+
+            frame += '\r';
+            frame += ANSI_CLEAR;
+            frame += lines[i].view();
+        }
+
+        if (frame.empty())
+            return false;
+
+        if (row != last) {
+            appendCursorMove(frame, last - row, 'B');
+        }
+    }
+
+    IoUtils::writeAll(fd, frame.data(), frame.size());
+
+    for (std::size_t i = 0; i < lines.size(); ++i) {
+        if (!(lines[i] == shown[i])) shown[i] = lines[i];
+    }
+
+    return true;
+}
@@ -1,6 +1,5 @@
 #include <functional>
 #include <cassert>
-#include <regex>
 #include <fstream>
 #include "json.hpp"
 #include "pch.hpp"
@@ -20,19 +19,26 @@ using json = nlohmann::json;
 using namespace PK;
 namespace Dose = UnitConverter::Dose;
 
-std::regex reConfigName{"^[a-z0-9]+?\\.json$", std::regex::icase};
+/* Config names are ASCII letters and digits only, so no path can be given. */
+bool isConfigNameSafe(std::string_view name)
+{
+    return !name.empty() && std::all_of(name.begin(), name.end(), [](char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+    });
+}
 
 void checkBadArgs(const ArgParser&, const SimulationInfo&);
 void checkConfig(ArgParser&, SimulationInfo&);
 
 struct HandleHelper {
-    Args::Metadata arg;
+    const Args::Metadata& arg;
     string label; // NOTE: if empty there will be no prompt
     std::function<void(string val)> handler;
     bool skipIfOneComp = false;
+    bool hasDefault = false; // an empty value is the default, used without prompting
 };
 
-void handleInput(ArgParser& parser, SimulationInfo& info)
+void handleInput(ArgParser& parser, SimulationInfo& info, bool isInteractive)
 {
     checkConfig(parser, info);
 
@@ -43,10 +49,37 @@ void handleInput(ArgParser& parser, SimulationInfo& info)
     drug.isDr = parser.isArgUsed(Args::DR) || parser.isArgUsed(Args::DR_FRAC);
     drug.isProdrug = parser.isArgUsed(Args::PRODRUG) ||
                      parser.isArgUsed(Args::T12M);
+    drug.isNonlinear = parser.isArgUsed(Args::VMAX) || parser.isArgUsed(Args::KM);
+    drug.hasPeripheral = parser.isArgUsed(Args::T12DIST) ||
+                         parser.isArgUsed(Args::T12REDIST);
+    const bool isInfused = parser.isArgUsed(Args::INFUSION);
+    if (isInfused) drug.dose = 0; // the dose is an optional loading bolus
+
     info.isMaxStatEnabled = parser.isArgUsed(Args::MAX);
     info.isAucEnabled = parser.isArgUsed(Args::AUC);
+    info.isAllocReportEnabled = parser.isArgUsed(Args::ALLOCS);
+    info.isProfileEnabled = parser.isArgUsed(Args::PROFILE);
+    info.isSteadyStateEnabled = parser.isArgUsed(Args::STEADY);
+    info.clockMode = parser.isArgUsed(Args::VIRTUAL) ? CLOCK_VIRTUAL : CLOCK_REAL;
+
+    /* Dose input in milligrams, handled the same way as the dose arg. */
+    auto doseInputToMg = [&](string val) {
+        auto inp = parseDoseInput(val);
+
+        if (inp.useBaseUnit && info.baseUnitsEnabled) {
+            return inp.value * Dose::toMgPerLiterFactor(inp.doseUnit, inp.baseUnit) * drug.vd;
+        }
+        return inp.value * Dose::toDefaultFactor(inp.doseUnit);
+    };
+
+    auto getSchedule = [&]() -> DoseSchedule& {
+        if (!drug.schedule.has_value()) drug.schedule.emplace();
+        return *drug.schedule;
+    };
 
     auto labelIfProdrug = [&](string str) { return drug.isProdrug ? str : ""; };
+    auto labelIfNonlinear = [&](string str) { return drug.isNonlinear ? str : ""; };
+    auto labelIfPeripheral = [&](string str) { return drug.hasPeripheral ? str : ""; };
     auto labelIfDr = [&](string str) { return drug.isDr ? str : ""; };
 
     checkBadArgs(parser, info);
@@ -56,10 +89,10 @@ void handleInput(ArgParser& parser, SimulationInfo& info)
     {
         {
             Args::ROA, "", [&](string val) {
-                for (const auto& it : roaToStringMap) {
-                    if (vectorContains(it.second, val)) { drug.roa = it.first; break; }
+                if (auto roa = UnitConverter::findUnit<ROA_TYPE>(val)) {
+                    drug.roa = *roa;
                 }
-                info.compModel = roaToCompModelMap.at(drug.roa);
+                info.compModel = roaCompModels[drug.roa];
                 isTwoCompModel = info.compModel == TWO_COMP_MODEL;
             }
         },
@@ -83,6 +116,27 @@ void handleInput(ArgParser& parser, SimulationInfo& info)
             }
         },
 
+        {
+            Args::RATE, "", [&](string val) {
+                info.tickRate = stod(val);
+                if (info.tickRate <= 0)
+                    throw std::invalid_argument("rate must be greater than 0");
+            }
+        },
+
+        {
+            Args::SPEED, "", [&](string val) {
+                info.clockSpeed = stod(val);
+                if (info.clockSpeed <= 0)
+                    throw std::invalid_argument("speed must be greater than 0");
+                if (info.clockMode == CLOCK_REAL) info.clockMode = CLOCK_SCALED;
+            }
+        },
+
+        {
+            Args::EXPORT, "", [&](string val) { info.exportPath = val; }
+        },
+
         {
             Args::SIGFIGS, "", [&](string val) {
                 info.sigfigs = std::clamp(stoi(val), 1, 6);
@@ -98,7 +152,7 @@ void handleInput(ArgParser& parser, SimulationInfo& info)
         },
 
         {
-            Args::DOSE, "dose: ", [&](string val)
+            Args::DOSE, isInfused ? "" : "dose: ", [&](string val)
             {
                 auto inp = parseDoseInput(val);
 
@@ -157,6 +211,95 @@ void handleInput(ArgParser& parser, SimulationInfo& info)
             }
         },
 
+        {
+            Args::EVERY, "", [&](string val) {
+                auto& schedule = getSchedule();
+                schedule.interval = timeInputToSeconds(val);
+
+                if (schedule.interval <= 0)
+                    throw std::invalid_argument("dose interval must be greater than 0");
+
+                if (!parser.isArgUsed(Args::DOSES)) {
+                    schedule.count = std::numeric_limits<std::size_t>::max();
+                }
+            }
+        },
+
+        {
+            Args::DOSES, "", [&](string val) {
+                getSchedule().count = std::stoul(val);
+
+                if (!parser.isArgUsed(Args::EVERY) && getSchedule().count > 1)
+                    throw std::invalid_argument("repeated doses require a dose interval");
+            }
+        },
+
+        {
+            Args::LOADING, "", [&](string val) {
+                getSchedule().loadingDose = doseInputToMg(val);
+            }
+        },
+
+        {
+            Args::SCHEDULE, "", [&](string val) {
+                auto& schedule = getSchedule();
+                std::istringstream stream(val);
+
+                // Each entry is <time>[@dose], dose defaults to the regular dose.
+                for (string part; std::getline(stream, part, ',');) {
+                    auto at = part.find('@');
+                    double t = timeInputToSeconds(part.substr(0, at));
+                    double dose = at == string::npos ? drug.dose :
+                                                       doseInputToMg(part.substr(at + 1));
+                    schedule.extraDoses.emplace_back(t, dose);
+                }
+            }
+        },
+
+        {
+            Args::INFUSION, "", [&](string val) {
+                if (drug.roa != ROA_TYPE_IV)
+                    throw std::logic_error("infusions must be intravenous");
+
+                auto& schedule = getSchedule();
+                std::istringstream stream(val);
+
+                // Each entry is <dose>/<duration>[@start], starting with the first dose.
+                for (string part; std::getline(stream, part, ',');) {
+                    auto at = part.find('@');
+                    auto slash = part.rfind('/', at);
+                    if (slash == string::npos)
+                        throw std::invalid_argument("infusion must be <dose>/<duration>");
+
+                    Infusion infusion;
+                    infusion.duration = timeInputToSeconds(part.substr(slash + 1, at - slash - 1));
+                    infusion.rate = doseInputToMg(part.substr(0, slash)) / infusion.duration;
+                    if (at != string::npos) {
+                        infusion.start = timeInputToSeconds(part.substr(at + 1));
+                    }
+
+                    if (infusion.duration <= 0 || infusion.rate <= 0)
+                        throw std::invalid_argument("infusion requires a duration and rate greater than 0");
+
+                    // Without a bolus the first infusion sets the displayed units.
+                    if (schedule.infusions.empty() && !parser.isArgUsed(Args::DOSE)) {
+                        auto inp = parseDoseInput(part.substr(0, slash));
+                        info.state.doseUnit = inp.doseUnit;
+
+                        if (inp.useBaseUnit && info.baseUnitsEnabled) {
+                            info.state.baseUnit = inp.baseUnit;
+                            info.doseUnitsEnabled = true;
+                        } else if (inp.useDoseUnit) {
+                            info.doseUnitsEnabled = true;
+                            info.isDoseUnitVolume = isDoseUnitVolume(inp.doseUnit);
+                        }
+                    }
+
+                    schedule.infusions.push_back(infusion);
+                }
+            }
+        },
+
         {
             Args::BIOAVAILABILITY, "bioavailability: ", [&](string val) {
                 setPercentagesToDecimal(val);
@@ -177,12 +320,22 @@ void handleInput(ArgParser& parser, SimulationInfo& info)
         },
 
         {
-            Args::T12, "half-life: ", [&](string val) {
+            Args::T12, drug.isNonlinear ? "" : "half-life: ", [&](string val) {
                 double t = timeInputToSeconds(val);
                 drug.ke = convertRateConstant(t);
             }
         },
 
+        {
+            Args::VMAX, labelIfNonlinear("max elimination rate per hour: "),
+            [&](string val) { drug.vmax = doseInputToMg(val) / 3600; }
+        },
+
+        {
+            Args::KM, labelIfNonlinear("half-max content: "),
+            [&](string val) { drug.km = doseInputToMg(val) / drug.vd; }
+        },
+
         {
             Args::PRODRUG, labelIfProdrug("active drug factor: "), [&](string val) {
                 setFractionsToDecimal(val);
@@ -208,6 +361,22 @@ void handleInput(ArgParser& parser, SimulationInfo& info)
             }
         },
 
+        {
+            Args::T12DIST, labelIfPeripheral("distribution half-life: "),
+            [&](string val) {
+                double t = timeInputToSeconds(val);
+                drug.k12 = convertRateConstant(t);
+            }
+        },
+
+        {
+            Args::T12REDIST, labelIfPeripheral("redistribution half-life: "),
+            [&](string val) {
+                double t = timeInputToSeconds(val);
+                drug.k21 = convertRateConstant(t);
+            }
+        },
+
         {
             Args::DR_FRAC, labelIfDr("delayed release fraction (def. 0.5): "),
                 [&](string val) {
@@ -215,7 +384,8 @@ void handleInput(ArgParser& parser, SimulationInfo& info)
                     if (val.empty()) { drug.drFrac = 0.5; return; }
                     setFractionsToDecimal(val);
                     drug.drFrac = stod(val);
-            }
+            },
+            false, true
         },
 
         {
@@ -231,6 +401,58 @@ void handleInput(ArgParser& parser, SimulationInfo& info)
             }
         },
 
+        {
+            Args::BATCH, "", [&](string val) {
+                std::istringstream stream(val);
+                std::vector<double> values;
+
+                for (string part; std::getline(stream, part, ':');) {
+                    values.push_back(timeInputToSeconds(part));
+                }
+
+                if (values.size() != 3) {
+                    throw std::invalid_argument("batch grid must be <start>:<end>:<step>");
+                }
+
+                info.batch = SimulationInfo::TimeGrid{values[0], values[1], values[2]};
+            }
+        },
+
+        {
+            Args::POPULATION, "", [&](string val) {
+                if (!info.population.has_value()) info.population.emplace();
+                info.population->subjects = std::stoul(val);
+            }
+        },
+
+        {
+            Args::CV, "", [&](string val) {
+                if (!info.population.has_value()) info.population.emplace();
+                auto& cv = info.population->cv;
+
+                std::istringstream stream(val);
+                std::size_t count = 0;
+
+                for (string part; std::getline(stream, part, ',');) {
+                    if (count == cv.size())
+                        throw std::invalid_argument("too many coefficients of variation");
+                    setFractionsToDecimal(part);
+                    setPercentagesToDecimal(part);
+                    cv[count++] = stod(part);
+                }
+
+                // A single value is used for every parameter.
+                if (count == 1) cv.fill(cv[0]);
+            }
+        },
+
+        {
+            Args::SEED, "", [&](string val) {
+                if (!info.population.has_value()) info.population.emplace();
+                info.population->seed = std::stoull(val);
+            }
+        },
+
         {
             Args::MIN, "", [&](string val) {
                 auto inp = parseDoseInput(val);
@@ -290,10 +512,17 @@ void handleInput(ArgParser& parser, SimulationInfo& info)
     for (const auto& it : helper)
     {
         if (parser.isArgUsed(it.arg)) {
-            it.handler(parser.getArgByFlag(it.arg.flag).value.value());
+            it.handler(parser.getArg(it.arg).value.value());
         }
         else if (!it.label.empty()) {
             if (info.compModel == ONE_COMP_MODEL && it.skipIfOneComp) continue;
+            if (!isInteractive && it.hasDefault) {
+                it.handler("");
+                continue;
+            }
+            if (!isInteractive) {
+                throw std::invalid_argument("missing value: " + string(it.arg.flag));
+            }
             std::cout << it.label;
             std::getline(std::cin, line);
             it.handler(line);
@@ -316,12 +545,10 @@ void checkConfig(ArgParser& parser, SimulationInfo& sim)
     if (!parser.isArgUsed(Args::ARG_FILE))
         return;
 
-    std::smatch match;
-
-    string path = parser.getArg(Args::ARG_FILE).value.value();
-    path += ".json";
+    const string& name = parser.getArg(Args::ARG_FILE).value.value();
+    const string path = name + ".json";
 
-    bool safe = std::regex_search(path, match, reConfigName);
+    bool safe = isConfigNameSafe(name);
     if (!safe) {
         throw std::invalid_argument("file name cannot be used: " + path);
     }
@@ -349,3 +576,34 @@ void checkConfig(ArgParser& parser, SimulationInfo& sim)
         }
     }
 }
+
+/*
+ * Config names given with repeated or comma separated file args, followed by
+ * the names in the list file (one per line, blank lines ignored).
+*/
+std::vector<string> getConfigNames(const ArgParser& parser)
+{
+    std::vector<string> names;
+
+    auto addName = [&](string name) {
+        auto first = name.find_first_not_of(" \t\r");
+        auto last = name.find_last_not_of(" \t\r");
+        if (first != string::npos)
+            names.push_back(name.substr(first, last - first + 1));
+    };
+
+    if (parser.isArgUsed(Args::ARG_FILE)) {
+        std::stringstream stream(parser.getArg(Args::ARG_FILE).value.value());
+        for (string name; std::getline(stream, name, ',');) addName(name);
+    }
+
+    if (parser.isArgUsed(Args::LIST)) {
+        std::ifstream ifs(parser.getArg(Args::LIST).value.value());
+        if (!ifs) {
+            throw std::invalid_argument("list file does not exist");
+        }
+        for (string name; std::getline(ifs, name);) addName(name);
+    }
+
+    return names;
+}
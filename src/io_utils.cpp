@@ -0,0 +1,38 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "pch.hpp"
+#include "io_utils.hpp"
+
+/* Write all of data, retrying partial writes and interrupts. */
+void IoUtils::writeAll(int fd, const char* data, std::size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = ::write(fd, data, size);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        else if (n < 0)
+            throw std::runtime_error(std::string("write failed: ") + std::strerror(errno));
+
+        data += n;
+        size -= n;
+    }
+}
+
+/* Open path for writing (truncated), "-" is standard output. */
+int IoUtils::openOutput(const std::string& path)
+{
+    if (path == "-")
+        return STDOUT_FILENO;
+
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd < 0) {
+        throw std::invalid_argument("cannot open '" + path + "': " + std::strerror(errno));
+    }
+
+    return fd;
+}
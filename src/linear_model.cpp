@@ -0,0 +1,389 @@
+#include <cmath>
+#include <stdexcept>
+#include "pch.hpp"
+#include "linear_model.hpp"
+
+using std::size_t;
+
+using Vector = LinearModel::Vector;
+using Matrix = LinearModel::Matrix;
+
+namespace
+{
+    constexpr size_t N = LinearModel::STATE_TOTAL;
+
+    // Largest norm of rates * step, the remainder of a step stays below it.
+    constexpr double STEP_NORM = 0x1p-8;
+
+    // Largest norm the pade approximant is used at before squaring.
+    constexpr double PADE_NORM = 0.5;
+
+    // Pade (6, 6) coefficients of exp.
+    constexpr double PADE[] = {
+        1.0, 1.0 / 2, 5.0 / 44, 1.0 / 66, 1.0 / 792, 1.0 / 15840, 1.0 / 665280
+    };
+
+    // Relative difference of time steps treated as the same step by sample.
+    constexpr double STEP_TOLERANCE = 1e-9;
+
+    Matrix identity()
+    {
+        Matrix m{};
+        for (size_t i = 0; i < N; ++i) m[i][i] = 1;
+        return m;
+    }
+
+    Matrix operator*(const Matrix& a, const Matrix& b)
+    {
+        Matrix c{};
+        for (size_t i = 0; i < N; ++i) {
+            for (size_t k = 0; k < N; ++k) {
+                for (size_t j = 0; j < N; ++j) {
+                    c[i][j] += a[i][k] * b[k][j];
+                }
+            }
+        }
+        return c;
+    }
+
+    Vector operator*(const Matrix& a, const Vector& x)
+    {
+        Vector y;
+#pragma GCC unroll 8
+        for (size_t i = 0; i < N; ++i) {
+            double sum = 0;
+#pragma GCC unroll 8
+            for (size_t j = 0; j < N; ++j) sum += a[i][j] * x[j];
+            y[i] = sum;
+        }
+        return y;
+    }
+
+    /* a * s + b * t, element wise. */
+    Matrix combine(const Matrix& a, double s, const Matrix& b, double t)
+    {
+        Matrix c;
+        for (size_t i = 0; i < N; ++i) {
+            for (size_t j = 0; j < N; ++j) {
+                c[i][j] = a[i][j] * s + b[i][j] * t;
+            }
+        }
+        return c;
+    }
+
+    Matrix scaled(const Matrix& a, double s)
+    {
+        return combine(a, s, Matrix{}, 0);
+    }
+
+    /* Largest absolute row sum. */
+    double normInf(const Matrix& a)
+    {
+        double norm = 0;
+        for (const auto& row : a) {
+            double sum = 0;
+            for (double v : row) sum += std::abs(v);
+            norm = std::max(norm, sum);
+        }
+        return norm;
+    }
+
+    /* Solve a * x = b for x by gaussian elimination with partial pivoting. */
+    Matrix solve(Matrix a, Matrix b)
+    {
+        for (size_t col = 0; col < N; ++col)
+        {
+            size_t pivot = col;
+            for (size_t i = col + 1; i < N; ++i) {
+                if (std::abs(a[i][col]) > std::abs(a[pivot][col])) pivot = i;
+            }
+            std::swap(a[col], a[pivot]);
+            std::swap(b[col], b[pivot]);
+
+            for (size_t i = col + 1; i < N; ++i)
+            {
+                const double f = a[i][col] / a[col][col];
+                for (size_t j = col; j < N; ++j) a[i][j] -= f * a[col][j];
+                for (size_t j = 0; j < N; ++j) b[i][j] -= f * b[col][j];
+            }
+        }
+
+        for (size_t col = N; col-- > 0;)
+        {
+            for (size_t j = 0; j < N; ++j) b[col][j] /= a[col][col];
+            for (size_t i = 0; i < col; ++i) {
+                for (size_t j = 0; j < N; ++j) b[i][j] -= a[i][col] * b[col][j];
+            }
+        }
+
+        return b;
+    }
+
+    /*
+     * exp(b) - I by the (6, 6) pade approximant, the norm of b must be under
+     * PADE_NORM. With odd part u and even part v of the numerator the
+     * approximant is (v - u)^-1 (v + u), so exp(b) - I is (v - u)^-1 2u.
+    */
+    Matrix expm1Pade(const Matrix& b)
+    {
+        const Matrix b2 = b * b;
+        const Matrix b4 = b2 * b2;
+        const Matrix b6 = b4 * b2;
+        const Matrix id = identity();
+
+        const Matrix odd = combine(combine(id, PADE[1], b2, PADE[3]), 1, b4, PADE[5]);
+        const Matrix u = b * odd;
+        const Matrix v = combine(combine(id, PADE[0], b2, PADE[2]), 1,
+                                 combine(b4, PADE[4], b6, PADE[6]), 1);
+
+        return solve(combine(v, 1, u, -1), scaled(u, 2));
+    }
+
+    /* (I + d)^2 - I, i.e. squares the exponential d is kept for. */
+    Matrix squareDelta(const Matrix& d)
+    {
+        return combine(d, 2, d * d, 1);
+    }
+
+    /*
+     * exp(a * r) * x for r under step by its taylor series, the norm of
+     * a * r is under STEP_NORM so four terms are exact to rounding.
+    */
+    Vector taylorStep(const Matrix& a, double r, const Vector& x)
+    {
+        Vector y = x;
+        for (int j = 4; j > 0; --j) {
+            const Vector ay = a * y;
+            for (size_t i = 0; i < N; ++i) y[i] = x[i] + r / j * ay[i];
+        }
+        return y;
+    }
+
+    Matrix taylorStep(const Matrix& a, double r)
+    {
+        const Matrix id = identity();
+        Matrix y = id;
+        for (int j = 4; j > 0; --j) {
+            y = combine(id, 1, a * y, r / j);
+        }
+        return y;
+    }
+
+    /* Whether t is too long to split into the propagators of the model. */
+    bool isBeyondLevels(const LinearModel& model, double t)
+    {
+        return !(t / model.step < std::ldexp(1.0, LinearModel::LEVELS));
+    }
+}
+
+/*
+ * Matrix exponential by pade approximant with scaling and squaring. The
+ * squarings work on exp(a) - I so rates much slower than the largest one do
+ * not round away against the identity.
+*/
+Matrix matrixExp(const Matrix& a)
+{
+    const double norm = normInf(a);
+
+    int squarings = 0;
+    if (norm > PADE_NORM) {
+        squarings = static_cast<int>(std::ceil(std::log2(norm / PADE_NORM)));
+    }
+
+    Matrix d = expm1Pade(scaled(a, std::ldexp(1.0, -squarings)));
+
+    for (int i = 0; i < squarings; ++i) {
+        d = squareDelta(d);
+    }
+
+    return combine(identity(), 1, d, 1);
+}
+
+/*
+ * exp(rates * t) * x for t >= 0, t is split into a whole number of steps,
+ * applied as one propagator per set bit, and a remainder under one step.
+*/
+Vector LinearModel::propagate(const Vector& x, double t) const
+{
+    if (isBeyondLevels(*this, t))
+        return matrixExp(scaled(rates, t)) * x;
+
+    const auto steps = static_cast<unsigned long long>(t / step);
+
+    Vector y = taylorStep(rates, t - steps * step, x);
+
+    for (size_t k = 0; k < LEVELS && (steps >> k) != 0; ++k) {
+        if ((steps >> k) & 1) {
+            const Vector dy = deltas[k] * y;
+            for (size_t i = 0; i < N; ++i) y[i] += dy[i];
+        }
+    }
+
+    return y;
+}
+
+/* exp(rates * t) for t >= 0, same splitting as propagate. */
+Matrix LinearModel::propagator(double t) const
+{
+    if (isBeyondLevels(*this, t))
+        return matrixExp(scaled(rates, t));
+
+    const auto steps = static_cast<unsigned long long>(t / step);
+
+    Matrix p = taylorStep(rates, t - steps * step);
+
+    for (size_t k = 0; k < LEVELS && (steps >> k) != 0; ++k) {
+        if ((steps >> k) & 1) p = combine(p, 1, deltas[k] * p, 1);
+    }
+
+    return p;
+}
+
+/* State at t since the dose, nothing is given before t = 0. */
+Vector LinearModel::at(double t) const
+{
+    if (t < 0)
+        return {};
+
+    Vector x = propagate(dose, t);
+
+    if (t >= drLag) {
+        const Vector delayed = propagate(drDose, t - drLag);
+        for (size_t i = 0; i < N; ++i) x[i] += delayed[i];
+    }
+
+    return x;
+}
+
+/*
+ * State at every time point, out[i] is the state at t[i]. Increasing times
+ * advance the previous state, a run of evenly spaced points is advanced by
+ * powers of one step propagator so each point costs one matrix vector product
+ * and the products of a run do not depend on each other.
+*/
+void LinearModel::sample(std::span<const double> t, std::span<Vector> out,
+                         StepCache& cache) const
+{
+    if (out.size() < t.size())
+        throw std::invalid_argument("output span is smaller than time span");
+
+    // Doses are not part of the propagator, restart where one is given.
+    auto isRestart = [&](size_t i) {
+        return i == 0 || t[i] < t[i - 1] || t[i - 1] < 0 ||
+               (t[i - 1] < drLag && t[i] >= drLag);
+    };
+
+    auto& powers = cache.powers;
+    auto isCachedStep = [&](size_t i) {
+        return std::abs(t[i] - t[i - 1] - cache.step) <= STEP_TOLERANCE * cache.step;
+    };
+
+    for (size_t i = 0; i < t.size();)
+    {
+        if (isRestart(i)) {
+            out[i] = at(t[i]);
+            ++i;
+            continue;
+        }
+
+        if (!isCachedStep(i)) {
+            cache.step = t[i] - t[i - 1];
+            powers[0] = propagator(cache.step);
+            for (size_t k = 1; k < SAMPLE_RUN; ++k) {
+                powers[k] = powers[0] * powers[k - 1];
+            }
+        }
+
+        size_t run = 1;
+        while (run < SAMPLE_RUN && i + run < t.size() &&
+               !isRestart(i + run) && isCachedStep(i + run)) {
+            ++run;
+        }
+
+        const Vector& from = out[i - 1];
+        for (size_t k = 0; k < run; ++k) {
+            out[i + k] = powers[k] * from;
+        }
+
+        i += run;
+    }
+}
+
+void LinearModel::sample(std::span<const double> t, std::span<Vector> out) const
+{
+    StepCache cache;
+    sample(t, out, cache);
+}
+
+/*
+ * Rate matrix and doses of the drug. Intravenous doses go to the central
+ * compartment, other routes are absorbed from the depot. Only the central
+ * compartment eliminates, the peripheral one exchanges with it.
+*/
+LinearModel makeLinearModel(const DrugInfo& drug, COMP_MODEL compModel)
+{
+    LinearModel model;
+    auto& a = model.rates;
+
+    const bool isBolus = compModel == ONE_COMP_MODEL;
+    const double ka = isBolus ? 0 : drug.ka;
+    const double& ke = drug.ke;
+
+    a[LinearModel::STATE_DEPOT][LinearModel::STATE_DEPOT] = -ka;
+    a[LinearModel::STATE_CENTRAL][LinearModel::STATE_DEPOT] = ka;
+    a[LinearModel::STATE_CENTRAL][LinearModel::STATE_CENTRAL] = -ke;
+    a[LinearModel::STATE_ELIMINATED][LinearModel::STATE_CENTRAL] = ke;
+
+    if (drug.hasPeripheral)
+    {
+        if (!drug.k12.has_value() || !drug.k21.has_value()) {
+            throw std::invalid_argument("peripheral compartment contains no info");
+        }
+
+        const double& k12 = *drug.k12;
+        const double& k21 = *drug.k21;
+
+        a[LinearModel::STATE_CENTRAL][LinearModel::STATE_CENTRAL] -= k12;
+        a[LinearModel::STATE_PERIPHERAL][LinearModel::STATE_CENTRAL] = k12;
+        a[LinearModel::STATE_CENTRAL][LinearModel::STATE_PERIPHERAL] = k21;
+        a[LinearModel::STATE_PERIPHERAL][LinearModel::STATE_PERIPHERAL] = -k21;
+    }
+
+    if (drug.isProdrug)
+    {
+        if (!drug.activeKe.has_value() || !drug.activeFrac.has_value()) {
+            throw std::invalid_argument("active drug from prodrug contains no info");
+        }
+
+        const double& km = *drug.activeKe;
+
+        a[LinearModel::STATE_ACTIVE][LinearModel::STATE_CENTRAL] = *drug.activeFrac * ke;
+        a[LinearModel::STATE_ACTIVE][LinearModel::STATE_ACTIVE] = -km;
+        a[LinearModel::STATE_ACTIVE_ELIMINATED][LinearModel::STATE_ACTIVE] = km;
+    }
+
+    const auto site = isBolus ? LinearModel::STATE_CENTRAL : LinearModel::STATE_DEPOT;
+    const double given = isBolus ? drug.dose : drug.bioavailability * drug.dose;
+
+    if (drug.isDr) {
+        const double drFrac = drug.drFrac.value();
+        model.dose[site] = given * (1 - drFrac);
+        model.drDose[site] = given * drFrac;
+        model.drLag = drug.drLagtime.value();
+    } else {
+        model.dose[site] = given;
+    }
+
+    /* Precompute the propagators, each level is the square of the last. */
+    const double norm = normInf(a);
+    if (norm > 0) {
+        model.step = std::ldexp(1.0, static_cast<int>(std::floor(std::log2(STEP_NORM / norm))));
+    }
+
+    model.deltas[0] = expm1Pade(scaled(a, model.step));
+    for (size_t k = 1; k < LinearModel::LEVELS; ++k) {
+        model.deltas[k] = squareDelta(model.deltas[k - 1]);
+    }
+
+    return model;
+}
@@ -1,10 +1,17 @@
+#include <stdexcept>
+#include <string>
+#include <vector>
 #include "simulation_info.hpp"
 #include "simulation.hpp"
 #include "argparser.hpp"
 #include "input_handler.hpp"
 #include "arg_constants.hpp"
+#include "time_utils.hpp"
+#include "column_file.hpp"
+#include "server.hpp"
 
 void setupArgs(ArgParser&);
+void startMulti(const ArgParser&, const std::vector<std::string>&);
 
 int main(int argc, char* argv[])
 {
@@ -13,9 +20,42 @@ int main(int argc, char* argv[])
 
     setupArgs(parser);
     parser.parse(argc, argv);
+
+    if (parser.isArgUsed(Args::READ)) {
+        dumpColumnFile(parser.getArg(Args::READ).value.value());
+        return 0;
+    }
+    else if (parser.isArgUsed(Args::SERVE)) {
+        startServer(parser, parser.getArg(Args::SERVE).value.value());
+        return 0;
+    }
+    else if (parser.isArgUsed(Args::CLIENT)) {
+        startClient(parser.getArg(Args::CLIENT).value.value());
+        return 0;
+    }
+
+    const auto configNames = getConfigNames(parser);
+
+    // Several configs share command line args and run in one process.
+    if (configNames.size() > 1) {
+        startMulti(parser, configNames);
+        return 0;
+    }
+    else if (configNames.size() == 1) {
+        parser.getArg(Args::ARG_FILE).value = configNames.front();
+    }
+
     handleInput(parser, simInfo);
 
-    startSimulation(simInfo);
+    if (simInfo.isSteadyStateEnabled) {
+        startSteadyState(simInfo);
+    } else if (simInfo.population.has_value()) {
+        startPopulation(simInfo);
+    } else if (simInfo.batch.has_value()) {
+        startBatch(simInfo);
+    } else {
+        startSimulation(simInfo);
+    }
 
     return 0;
 }
@@ -25,5 +65,43 @@ void setupArgs(ArgParser& parser)
     for (const auto& it : globalArgs) {
         parser.addArg(*it);
     }
-    parser.sortArgs();
+}
+
+void startMulti(const ArgParser& parser, const std::vector<std::string>& names)
+{
+    const bool isCombined = parser.isArgUsed(Args::COMBINE);
+    const bool isBatch = parser.isArgUsed(Args::BATCH);
+
+    if (parser.isArgUsed(Args::POPULATION)) {
+        throw std::invalid_argument("population mode cannot use multiple configs");
+    }
+    else if (parser.isArgUsed(Args::STEADY)) {
+        throw std::invalid_argument("steady state cannot use multiple configs");
+    }
+    else if (isBatch && !isCombined) {
+        throw std::invalid_argument("multiple configs in batch mode require combine");
+    }
+
+    std::vector<SimulationInfo> sims(names.size());
+
+    for (std::size_t i = 0; i < names.size(); ++i)
+    {
+        // Each config gets its own copy so file values do not leak between them.
+        ArgParser configParser = parser;
+        configParser.getArg(Args::ARG_FILE).value = names[i];
+
+        handleInput(configParser, sims[i]);
+    }
+
+    // Configs without a time of their own are all given at the same instant,
+    // the live dashboard starts them when its clock starts.
+    if (isBatch) {
+        const auto now = getEpoch();
+        for (auto& sim : sims) {
+            if (!sim.epoch.count()) sim.epoch = now;
+        }
+        startCombinedBatch(sims);
+    } else {
+        startMultiSimulation(sims, isCombined);
+    }
 }
@@ -0,0 +1,408 @@
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include "pch.hpp"
+#include "nonlinear_model.hpp"
+
+using std::size_t;
+
+using Vector = NonlinearModel::Vector;
+
+namespace
+{
+    constexpr size_t N = NonlinearModel::STATE_TOTAL;
+    constexpr size_t STAGES = 7;
+
+    constexpr double INF = std::numeric_limits<double>::infinity();
+
+    /* Dormand-Prince 5(4) tableau, the last row is the 5th order solution. */
+    constexpr double A[STAGES][STAGES - 1] = {
+        {},
+        {1.0 / 5},
+        {3.0 / 40, 9.0 / 40},
+        {44.0 / 45, -56.0 / 15, 32.0 / 9},
+        {19372.0 / 6561, -25360.0 / 2187, 64448.0 / 6561, -212.0 / 729},
+        {9017.0 / 3168, -355.0 / 33, 46732.0 / 5247, 49.0 / 176, -5103.0 / 18656},
+        {35.0 / 384, 0, 500.0 / 1113, 125.0 / 192, -2187.0 / 6784, 11.0 / 84},
+    };
+
+    // 5th less 4th order weights, the local error estimate.
+    constexpr double E[STAGES] = {
+        71.0 / 57600, 0, -71.0 / 16695, 71.0 / 1920, -17253.0 / 339200, 22.0 / 525, -1.0 / 40
+    };
+
+    // Weights of the 4th order dense output (Hairer and Wanner).
+    constexpr double D[STAGES] = {
+        -12715105075.0 / 11282082432, 0, 87487479700.0 / 32700410799,
+        -10690763975.0 / 1880347072, 701980252875.0 / 199316789632,
+        -1453857185.0 / 822651844, 69997945.0 / 29380423
+    };
+
+    // Relative tolerance of each step, the absolute one is per mg of dose.
+    constexpr double REL_TOLERANCE = 1e-9;
+    constexpr double ABS_TOLERANCE = 1e-12;
+
+    // Bounds of the step size change after each attempt.
+    constexpr double SAFETY = 0.9;
+    constexpr double MIN_FACTOR = 0.2;
+    constexpr double MAX_FACTOR = 5.0;
+
+    // First step as a fraction of the fastest time scale.
+    constexpr double INITIAL_STEP = 0.01;
+
+    /* y + h * sum of a[j] * k[j] over the first count stages. */
+    Vector stage(const Vector& y, double h, const double* a,
+                 const std::array<Vector, STAGES>& k, size_t count)
+    {
+        Vector out = y;
+        for (size_t j = 0; j < count; ++j) {
+            if (a[j] == 0) continue;
+            for (size_t i = 0; i < N; ++i) out[i] += h * a[j] * k[j][i];
+        }
+        return out;
+    }
+
+    /* Next dose time of the train after t, infinity if none. */
+    double nextTrainDose(const DoseTrain& train, double t)
+    {
+        if (t < train.start)
+            return train.start;
+        else if (train.interval <= 0)
+            return INF;
+
+        const double n = std::floor((t - train.start) / train.interval) + 1;
+        if (n >= static_cast<double>(train.count))
+            return INF;
+
+        const double next = train.start + n * train.interval;
+
+        return next > t ? next : train.start + (n + 1) * train.interval;
+    }
+}
+
+/* Dense output of the step at t within it. */
+Vector NonlinearModel::Step::at(double time) const
+{
+    if (h == 0)
+        return cont[0];
+
+    const double s = (time - t) / h;
+    const double s1 = 1 - s;
+
+    Vector y;
+    for (size_t i = 0; i < N; ++i) {
+        y[i] = cont[0][i] + s * (cont[1][i] + s1 * (cont[2][i] +
+               s * (cont[3][i] + s1 * cont[4][i])));
+    }
+    return y;
+}
+
+Vector NonlinearModel::derivative(const Vector& x) const
+{
+    const double c = x[LinearModel::STATE_CENTRAL] / vd;
+    const double eliminated = vmax * c / (km + c);
+    const double absorbed = ka * x[LinearModel::STATE_DEPOT];
+    const double distributed = k12 * x[LinearModel::STATE_CENTRAL] -
+                               k21 * x[LinearModel::STATE_PERIPHERAL];
+    const double activeEliminated = activeKe * x[LinearModel::STATE_ACTIVE];
+
+    Vector dx{};
+    dx[LinearModel::STATE_DEPOT] = -absorbed;
+    dx[LinearModel::STATE_CENTRAL] = absorbed - eliminated - distributed + x[STATE_INFUSION];
+    dx[LinearModel::STATE_PERIPHERAL] = distributed;
+    dx[LinearModel::STATE_ACTIVE] = activeFrac * eliminated - activeEliminated;
+    dx[LinearModel::STATE_ELIMINATED] = eliminated;
+    dx[LinearModel::STATE_ACTIVE_ELIMINATED] = activeEliminated;
+    dx[STATE_AREA] = x[LinearModel::STATE_CENTRAL];
+
+    return dx;
+}
+
+/* First dose time, or infusion start or end, after t. Infinity if none. */
+double NonlinearModel::nextDoseTime(double t) const
+{
+    double next = INF;
+    for (const auto& train : trains) {
+        next = std::min(next, nextTrainDose(train, t));
+    }
+
+    for (const auto& infusion : infusions) {
+        const double end = infusion.start + infusion.duration;
+        if (infusion.start > t) next = std::min(next, infusion.start);
+        else if (end > t) next = std::min(next, end);
+    }
+
+    return next;
+}
+
+/* Total dose given at exactly time t. */
+double NonlinearModel::doseAt(double t) const
+{
+    double dose = 0;
+
+    for (const auto& train : trains)
+    {
+        if (train.interval <= 0) {
+            if (train.start == t) dose += train.dose;
+            continue;
+        }
+
+        const double n = std::round((t - train.start) / train.interval);
+        if (n >= 0 && n < static_cast<double>(train.count) &&
+            train.start + n * train.interval == t) {
+            dose += train.dose;
+        }
+    }
+
+    return dose;
+}
+
+/* Change of the infusion rate at exactly time t. */
+double NonlinearModel::rateChangeAt(double t) const
+{
+    double change = 0;
+
+    for (const auto& infusion : infusions) {
+        if (infusion.start == t) change += infusion.rate;
+        if (infusion.start + infusion.duration == t) change -= infusion.rate;
+    }
+
+    return change;
+}
+
+/*
+ * Time of the final dose or the end of the final infusion, infinite if doses
+ * are repeated indefinitely.
+*/
+double NonlinearModel::lastDoseTime() const
+{
+    double last = 0;
+
+    for (const auto& infusion : infusions) {
+        last = std::max(last, infusion.start + infusion.duration);
+    }
+
+    for (const auto& train : trains)
+    {
+        if (train.interval <= 0) {
+            last = std::max(last, train.start);
+        }
+        else if (train.count == std::numeric_limits<size_t>::max()) {
+            return INF;
+        }
+        else {
+            last = std::max(last, train.start + (train.count - 1) * train.interval);
+        }
+    }
+
+    return last;
+}
+
+/* Cursor right after the doses given at time 0. */
+NonlinearModel::Cursor NonlinearModel::start() const
+{
+    Cursor c;
+    c.t = 0;
+    c.y[site] = doseScale * doseAt(0);
+    c.y[STATE_INFUSION] = rateChangeAt(0);
+    c.dy = derivative(c.y);
+    c.step.cont[0] = c.y;
+
+    const double fastest = std::max({ka, k12 + k21, activeKe, vmax / (km * vd)});
+    c.h = fastest > 0 ? INITIAL_STEP / fastest : 1;
+
+    return c;
+}
+
+/*
+ * Take one accepted step, steps are shortened to end at the next dose time
+ * where the dose is added to the state.
+*/
+void NonlinearModel::advance(Cursor& c) const
+{
+    const double stop = nextDoseTime(c.t);
+
+    std::array<Vector, STAGES> k;
+    k[0] = c.dy;
+
+    for (;;)
+    {
+        const bool isStop = c.t + c.h >= stop;
+        const double h = isStop ? stop - c.t : c.h;
+
+        for (size_t s = 1; s < STAGES; ++s) {
+            k[s] = derivative(stage(c.y, h, A[s], k, s));
+        }
+        const Vector y1 = stage(c.y, h, A[STAGES - 1], k, STAGES - 1);
+
+        double err = 0;
+        for (size_t i = 0; i < N; ++i)
+        {
+            double e = 0;
+            for (size_t j = 0; j < STAGES; ++j) e += E[j] * k[j][i];
+
+            const double scale = absTolerance + REL_TOLERANCE *
+                                 std::max(std::abs(c.y[i]), std::abs(y1[i]));
+            err = std::max(err, std::abs(h * e) / scale);
+        }
+
+        const double factor = err == 0 ? MAX_FACTOR :
+                              std::clamp(SAFETY * std::pow(err, -0.2), MIN_FACTOR, MAX_FACTOR);
+
+        if (err > 1) {
+            c.h = h * factor;
+            if (c.h <= std::abs(c.t) * std::numeric_limits<double>::epsilon()) {
+                throw std::runtime_error("nonlinear elimination step size underflow");
+            }
+            continue;
+        }
+
+        /* Dense output of the accepted step. */
+        auto& cont = c.step.cont;
+        for (size_t i = 0; i < N; ++i)
+        {
+            double d = 0;
+            for (size_t j = 0; j < STAGES; ++j) d += D[j] * k[j][i];
+
+            cont[0][i] = c.y[i];
+            cont[1][i] = y1[i] - c.y[i];
+            cont[2][i] = h * k[0][i] - cont[1][i];
+            cont[3][i] = cont[1][i] - h * k[STAGES - 1][i] - cont[2][i];
+            cont[4][i] = h * d;
+        }
+        c.step.t = c.t;
+        c.step.h = h;
+
+        // A shortened step keeps the size the controller would have used.
+        if (!isStop || h * factor > c.h) c.h = h * factor;
+
+        c.t = isStop ? stop : c.t + h;
+        c.y = y1;
+        c.dy = k[STAGES - 1];
+
+        if (isStop) {
+            c.y[site] += doseScale * doseAt(stop);
+            c.y[STATE_INFUSION] += rateChangeAt(stop);
+            c.dy = derivative(c.y);
+        }
+        return;
+    }
+}
+
+/*
+ * State at t since the first dose, the cursor is advanced to t and reused by
+ * later times. Times before the cursor's last step start over.
+*/
+Vector NonlinearModel::at(double t, Cursor& c) const
+{
+    if (t < 0)
+        return {};
+
+    if (c.t < 0 || t < c.step.t) {
+        c = start();
+    }
+
+    while (t > c.t) {
+        advance(c);
+    }
+
+    return t == c.t ? c.y : c.step.at(t);
+}
+
+Vector NonlinearModel::at(double t) const
+{
+    Cursor c;
+    return at(t, c);
+}
+
+/*
+ * State at every time point, out[i] is the state at t[i]. Increasing times
+ * are integrated once and interpolated by the dense output of each step.
+*/
+void NonlinearModel::sample(std::span<const double> t, std::span<Vector> out) const
+{
+    if (out.size() < t.size())
+        throw std::invalid_argument("output span is smaller than time span");
+
+    Cursor c;
+    for (size_t i = 0; i < t.size(); ++i) {
+        out[i] = at(t[i], c);
+    }
+}
+
+/*
+ * Model of the drug and its doses. Doses are split into their immediate and
+ * delayed portion like makeRegimenCurve, a loading dose adds the difference.
+*/
+NonlinearModel makeNonlinearModel(const DrugInfo& drug, COMP_MODEL compModel)
+{
+    if (!drug.vmax.has_value() || !drug.km.has_value()) {
+        throw std::invalid_argument("nonlinear elimination contains no info");
+    }
+
+    const bool isBolus = compModel == ONE_COMP_MODEL;
+
+    NonlinearModel model;
+    model.ka = isBolus ? 0 : drug.ka;
+    model.vmax = *drug.vmax;
+    model.km = *drug.km;
+    model.vd = drug.vd;
+
+    if (drug.hasPeripheral) {
+        model.k12 = drug.k12.value();
+        model.k21 = drug.k21.value();
+    }
+
+    if (drug.isProdrug)
+    {
+        if (!drug.activeKe.has_value() || !drug.activeFrac.has_value()) {
+            throw std::invalid_argument("active drug from prodrug contains no info");
+        }
+        model.activeFrac = *drug.activeFrac;
+        model.activeKe = *drug.activeKe;
+    }
+
+    model.site = isBolus ? LinearModel::STATE_CENTRAL : LinearModel::STATE_DEPOT;
+    model.doseScale = isBolus ? 1 : drug.bioavailability;
+
+    const double drFrac = drug.isDr ? drug.drFrac.value() : 0.0;
+    const double drLag = drug.isDr ? drug.drLagtime.value() : 0.0;
+
+    auto addTrain = [&](double start, double interval, size_t count, double dose) {
+        model.trains.push_back({start, interval, count, dose * (1 - drFrac)});
+        if (drug.isDr) {
+            model.trains.push_back({start + drLag, interval, count, dose * drFrac});
+        }
+    };
+
+    double largest = drug.dose;
+
+    if (!drug.schedule.has_value()) {
+        addTrain(0, 0, 1, drug.dose);
+    }
+    else {
+        const auto& schedule = *drug.schedule;
+
+        if (schedule.interval > 0) addTrain(0, schedule.interval, schedule.count, drug.dose);
+        else addTrain(0, 0, 1, drug.dose);
+
+        if (schedule.loadingDose.has_value()) {
+            addTrain(0, 0, 1, *schedule.loadingDose - drug.dose);
+            largest = std::max(largest, *schedule.loadingDose);
+        }
+
+        for (const auto& [t, dose] : schedule.extraDoses) {
+            addTrain(t, 0, 1, dose);
+            largest = std::max(largest, dose);
+        }
+
+        model.infusions = schedule.infusions;
+        for (const auto& it : schedule.infusions) {
+            largest = std::max(largest, it.rate * it.duration);
+        }
+    }
+
+    model.absTolerance = ABS_TOLERANCE * model.doseScale * largest;
+
+    return model;
+}
@@ -1,9 +1,10 @@
 #include <stdexcept>
-#include <cassert>
 #include "pch.hpp"
 #include "pk_utils.hpp"
 #include "simulation_info.hpp"
 #include "drug_info.hpp"
+#include "linear_model.hpp"
+#include "vec_math.hpp"
 
 using std::exp;
 using std::log;
@@ -11,211 +12,182 @@ using std::log;
 namespace OneComp = PK::OneCompartment;
 namespace TwoComp = PK::TwoCompartment;
 
+// Time points handled per pass by the dense kernels (temporaries stay on stack).
+constexpr std::size_t KERNEL_BLOCK = 256;
+
+// Separates equal rate constants so exponential terms stay finite.
+constexpr double EQUAL_RATE_MULT = 1.00001;
+
 void throwInvalidArg(std::string text)
 {
     throw std::invalid_argument(text);
 }
 
-double computeDrugContent(const SimulationInfo& simInfo, double elapsed)
+void checkKernelSpans(std::span<const double> t, std::span<double> out)
 {
-    const auto& drug = simInfo.drugInfo;
-    const auto& dose = drug.dose;
-    const int& model = simInfo.compModel;
-
-    switch (model)
-    {
-        case ONE_COMP_MODEL:
-            return OneComp::computeDrugContent(drug, dose, elapsed);
-        case TWO_COMP_MODEL:
-            if (drug.isDr) {
-                return TwoComp::computeDrugContentDr(drug, dose, elapsed);
-            }
-            return TwoComp::computeDrugContent(drug, dose, elapsed);
-    }
-
-    return 0.0;
+    if (out.size() < t.size())
+        throwInvalidArg("output span is smaller than time span");
 }
 
-double OneComp::computeDrugContent(const DrugInfo& drug, double dose, double t)
+/* Drug content (in mg or mg/L) of the single dose model at elapsed. */
+double computeDrugContent(const SimulationInfo& simInfo, double elapsed)
 {
-    return drug.dose / drug.vd * exp(-drug.ke * t);
-}
+    if (simInfo.nonlinear.has_value()) {
+        const auto x = simInfo.nonlinear->at(elapsed);
+        return x[LinearModel::STATE_CENTRAL] / simInfo.drugInfo.vd;
+    }
 
-double OneComp::computeExcreted(const DrugInfo& drug, const double& t)
-{
-    const float& fe = drug.excretionFrac;
-    const float& vd = drug.vd;
-    const double& dose = drug.dose;
-    const double& ke = drug.ke;
+    const auto x = simInfo.model.at(elapsed);
 
-    return fe * dose / vd * (1 - exp(-ke * t));
+    return x[LinearModel::STATE_CENTRAL] / simInfo.drugInfo.vd;
 }
 
-/* Compute the amount of a metabolite remaining. */
-double OneComp::computeMetaboliteContent(const DrugInfo& drug, const double& t)
+/*
+ * Compute drug content for every time point in elapsed. Without a peripheral
+ * compartment the closed forms are evaluated with vectorized exp, which is
+ * several times faster than sampling the model, the delayed release portion
+ * is added for points past its lagtime.
+*/
+void computeDrugContent(const SimulationInfo& simInfo,
+                        std::span<const double> elapsed, std::span<double> out)
 {
-    if (!drug.activeKe.has_value())
-        throwInvalidArg("metabolite has no elimination constant");
+    checkKernelSpans(elapsed, out);
 
-    const double& ke = drug.ke;
-    const double& km = *drug.activeKe;
+    const auto& drug = simInfo.drugInfo;
+    const double vd = drug.vd;
 
-    double result = drug.dose * *drug.activeFrac;
-    result *= exp(-ke * t) / (km - ke) + exp(-km * t) / (ke - km);
+    // Integrated once along the time points, each one is interpolated.
+    if (simInfo.nonlinear.has_value()) {
+        NonlinearModel::Cursor cursor;
+        for (std::size_t i = 0; i < elapsed.size(); ++i) {
+            out[i] = simInfo.nonlinear->at(elapsed[i], cursor)[LinearModel::STATE_CENTRAL] / vd;
+        }
+        return;
+    }
 
-    return result / 3600;
-}
+    if (!drug.hasPeripheral)
+    {
+        const double& dose = drug.dose;
 
-double OneComp::computeMetaboliteExcreted(const DrugInfo& drug, const double& t)
-{
-    const double& ke = drug.ke;
-    const double& km = *drug.activeKe;
-    const float& fe = drug.excretionFrac;
+        if (simInfo.compModel == ONE_COMP_MODEL) {
+            OneComp::computeDrugContent(drug, dose, elapsed, out);
+            return;
+        }
+        else if (!drug.isDr) {
+            TwoComp::computeDrugContent(drug, dose, elapsed, out);
+            return;
+        }
 
-    double result = 1 - exp(-ke * t) - ke/km * (1 - exp(-km * t));
-    result *= fe * drug.dose * *drug.activeFrac * ke / (km - ke);
+        const double lag = drug.drLagtime.value();
+        const double drDose = drug.drFrac.value() * dose;
 
-    return result;
-}
+        TwoComp::computeDrugContent(drug, dose - drDose, elapsed, out);
 
-/*
- * Compute the area under curve for metabolite.
- *
- * @note: Units are in hours.
-*/
-double OneComp::computeMetaboliteAuc(const DrugInfo& drug, const double& t)
-{
-    assert(drug.activeKe.has_value());
+        double shifted[KERNEL_BLOCK];
+        double delayed[KERNEL_BLOCK];
 
-    const double& ke = drug.ke;
-    const double& km = *drug.activeKe;
+        for (std::size_t pos = 0; pos < elapsed.size(); pos += KERNEL_BLOCK)
+        {
+            const std::size_t n = std::min(KERNEL_BLOCK, elapsed.size() - pos);
+            const double* t = elapsed.data() + pos;
+
+            for (std::size_t i = 0; i < n; ++i) {
+                shifted[i] = t[i] - lag;
+            }
 
-    if (ke == km) {
-        double result = (1 - exp(-ke * t) * (ke * t + 1)) / (ke * ke);
-        result *= drug.dose * ke * *drug.activeFrac;
+            TwoComp::computeDrugContent(drug, drDose, {shifted, n}, {delayed, n});
 
-        return result / 3600;
+            for (std::size_t i = 0; i < n; ++i) {
+                out[pos + i] += t[i] >= lag ? delayed[i] : 0.0;
+            }
+        }
+        return;
     }
 
-    double result = ke / (km - ke) * drug.dose * *drug.activeFrac;
-    result *= (1 - exp(-ke * t)) / ke - (1 - exp(-km * t)) / km;
+    LinearModel::Vector states[KERNEL_BLOCK];
+    LinearModel::StepCache cache;
 
-    return result / 3600;
-}
+    for (std::size_t pos = 0; pos < elapsed.size(); pos += KERNEL_BLOCK)
+    {
+        const std::size_t n = std::min(KERNEL_BLOCK, elapsed.size() - pos);
 
-double TwoComp::computeDrugContent(const DrugInfo& drug, double dose, double t)
-{
-    const double& ka = drug.ka;
-    const double& ke = drug.ke;
-    const float& vd = drug.vd;
-    const float& bio = drug.bioavailability;
+        simInfo.model.sample(elapsed.subspan(pos, n), {states, n}, cache);
 
-    if (ka == ke) {
-        return bio * dose * ke / vd * t * exp(-ke * t);
+        for (std::size_t i = 0; i < n; ++i) {
+            out[pos + i] = states[i][LinearModel::STATE_CENTRAL] / vd;
+        }
     }
-
-    return (bio * dose * ka) / (vd * (ka - ke)) * (exp(-ke * t) - exp(-ka * t));
 }
 
-double TwoComp::computeExcreted(const DrugInfo& drug, const double& t)
+/* Dense form of the one compartment content, out[i] is the content at t[i]. */
+void OneComp::computeDrugContent(const DrugInfo& drug, double dose,
+                                 std::span<const double> t, std::span<double> out)
 {
-    const double& dose = drug.dose;
-    const float& frac = drug.excretionFrac;
-    const float& bio = drug.bioavailability;
-    const double& ke = drug.ke;
-    const double& ka = drug.ka;
-
-    double result;
-
-    if (drug.isDr) {
-        const float& drFrac = *drug.drFrac;
-        const float& lag = *drug.drLagtime;
-
-        result = frac * bio * (1 - drFrac) * dose * ka / ((ka - ke) * drug.vd);
-        result *= (1 - exp(-ke * t)) - ke/ka * (1 - exp(-ka * t));
-
-        if (t < lag)
-            return result;
+    checkKernelSpans(t, out);
 
-        double add = frac * bio * (drFrac * dose) * ka / ((ka - ke) * drug.vd);
-        add *= (1 - exp(-ke * (t - lag))) - ke/ka * (1 - exp(-ka * (t - lag)));
+    const double scale = dose / drug.vd;
+    const double& ke = drug.ke;
 
-        return result + add;
+    for (std::size_t i = 0; i < t.size(); ++i) {
+        out[i] = -ke * t[i];
     }
 
-    result = frac * bio * dose * ka / ((ka - ke) * drug.vd);
-    result *= (1 - exp(-ke * t)) - ke/ka * (1 - exp(-ka * t));
+    VecMath::exp(out.data(), out.data(), t.size());
 
-    return result;
+    for (std::size_t i = 0; i < t.size(); ++i) {
+        out[i] *= scale;
+    }
 }
 
-/*
- * Return the active drug content from the prodrug.
-*/
-double TwoComp::computeMetaboliteContent(const DrugInfo& drug, const double& t)
+/* Dense form of the two compartment content, out[i] is the content at t[i]. */
+void TwoComp::computeDrugContent(const DrugInfo& drug, double dose,
+                                 std::span<const double> t, std::span<double> out)
 {
-    if (!drug.activeKe.has_value() || !drug.activeFrac.has_value()) {
-        throw std::invalid_argument("active drug from prodrug contains no info");
-    }
+    checkKernelSpans(t, out);
 
-    const float& bio = drug.bioavailability; // alias because I hate long names
-    const float& activeFrac = drug.activeFrac.value();
+    const double& ka = drug.ka;
+    const double& ke = drug.ke;
+    const float& vd = drug.vd;
+    const float& bio = drug.bioavailability;
 
-    std::vector<const double*> rates{&drug.ka, &drug.ke, &drug.activeKe.value()};
+    if (ka == ke) {
+        const double scale = bio * dose * ke / vd;
 
-    /* https://en.wikipedia.org/wiki/Bateman_equation */
-    double sum = 0.0; // sum of iter
-    for (auto i = 0u; i < rates.size(); ++i) {
-        double num = exp(-*rates[i] * t);
-        double den = 1.0;
-        for (auto j = 0u; j < rates.size(); ++j) {
-            if (j == i)
-                continue;
-            den *= (*rates[j] - *rates[i]);
+        for (std::size_t i = 0; i < t.size(); ++i) {
+            out[i] = -ke * t[i];
         }
-        sum += num / den;
-    }
 
-    return (drug.dose * activeFrac * bio) * (drug.ka * drug.ke) * sum;
-}
+        VecMath::exp(out.data(), out.data(), t.size());
 
-double TwoComp::computeMetaboliteExcreted(const DrugInfo& drug, const double& t)
-{
-    const double& dose = drug.dose;
-    const double& activeFrac = *drug.activeFrac;
-    const float& bio = drug.bioavailability;
-    const double& ka = drug.ka;
-    const double& ke = drug.ke;
-    const double& km = *drug.activeKe;
-    const float& fe = drug.excretionFrac;
+        for (std::size_t i = 0; i < t.size(); ++i) {
+            out[i] *= scale * t[i];
+        }
 
-    double result = (1 - exp(-ka * t)) / (ka * (ke - ka) * (km - ka));
-    result += (1 - exp(-ke * t)) / (ke * (ka - ke) * (km - ke));
-    result += (1 - exp(-km * t)) / (km * (ka - km) * (ke - km));
-    result *= ka * ke * bio * activeFrac * dose;
-    result *= fe * km;
+        return;
+    }
 
-    return result;
-}
+    const double scale = (bio * dose * ka) / (vd * (ka - ke));
 
-double TwoComp::computeDrugContentDr(const DrugInfo& drug, double dose, const double& t)
-{
-    if (!drug.isDr)
-        throw std::invalid_argument("dr drug contains no info");
+    double absorbed[KERNEL_BLOCK]; // exp(-ka * t) of the current block
 
-    const double& lag = drug.drLagtime.value();
+    for (std::size_t pos = 0; pos < t.size(); pos += KERNEL_BLOCK)
+    {
+        const std::size_t n = std::min(KERNEL_BLOCK, t.size() - pos);
+        const double* tBlock = t.data() + pos;
+        double* outBlock = out.data() + pos;
 
-    double delayedDose = drug.drFrac.value() * dose;
+        for (std::size_t i = 0; i < n; ++i) {
+            outBlock[i] = -ke * tBlock[i];
+            absorbed[i] = -ka * tBlock[i];
+        }
 
-    // Reduce dose value to the IR frac dose.
-    dose *= 1.0 - drug.drFrac.value();
+        VecMath::exp(outBlock, outBlock, n);
+        VecMath::exp(absorbed, absorbed, n);
 
-    double result = TwoComp::computeDrugContent(drug, dose, t);
-    if (t >= lag) {
-        result += TwoComp::computeDrugContent(drug, delayedDose, t - lag);
+        for (std::size_t i = 0; i < n; ++i) {
+            outBlock[i] = scale * (outBlock[i] - absorbed[i]);
+        }
     }
-
-    return result;
 }
 
 bool TwoComp::computeIsAbsorbed(const DrugInfo& drug, const double& t)
@@ -235,87 +207,95 @@ double TwoComp::computeTmax(const DrugInfo& drug)
 }
 
 /*
- * Compute area under curve for one compartment model.
+ * Convolve the terms with a first-order transfer at rate k, i.e. the content
+ * of a compartment filled at scale * terms(t) and emptied at k. Each term
+ * c * exp(-r * t) becomes scale * c / (k - r) * (exp(-r * t) - exp(-k * t)).
  *
- * @note: units are in hours
+ * @note: k is separated slightly from equal rates
 */
-double OneComp::computeAuc(const DrugInfo& drug, const double& dose, const double& t)
+ExpTerms convolveTerms(const ExpTerms& terms, double k, double scale)
 {
-    const double& ke = drug.ke;
+    for (std::size_t i = 0; i < terms.size; ++i) {
+        if (terms.rate[i] == k) k *= EQUAL_RATE_MULT;
+    }
+
+    ExpTerms out;
+    double last = 0.0;
+
+    for (std::size_t i = 0; i < terms.size; ++i) {
+        const double c = scale * terms.coef[i] / (k - terms.rate[i]);
+        out.add(c, terms.rate[i]);
+        last -= c;
+    }
+    out.add(last, k);
 
-    return (1 - exp(-ke * t)) / ke * dose / 3600;
+    return out;
 }
 
 /*
- * Compute area under curve for two compartment model.
- *
- * @note: units are in hours
+ * Return the disposition rates of the central and peripheral compartments,
+ * the roots of s^2 - (ke + k12 + k21) * s + k21 * ke.
 */
-double TwoComp::computeAuc(const DrugInfo& drug, const double& dose, const double& t)
+PK::HybridRates PK::computeHybridRates(const DrugInfo& drug)
 {
-    const double& ka = drug.ka;
     const double& ke = drug.ke;
-    const float& bio = drug.bioavailability;
+    const double& k12 = drug.k12.value();
+    const double& k21 = drug.k21.value();
 
-    if (ka == ke) {
-        double result = (1 - exp(-ke * t) * (ke * t + 1)) / (ke * ke);
-        result *= dose * bio * ke;
-
-        return result / 3600;
-    }
+    const double sum = ke + k12 + k21;
+    const double alpha = 0.5 * (sum + std::sqrt(sum * sum - 4 * k21 * ke));
 
-    double result = (1 - exp(-ke * t)) / ke;
-    result -= (1 - exp(-ka * t)) / ka;
-    result *= bio * dose * ka / (ka - ke);
-
-    return result / 3600;
+    // Product of the roots, avoids cancellation of the smaller root.
+    return {alpha, k21 * ke / alpha};
 }
 
 /*
- * Compute area under curve for delayed release drug in two compartment model.
+ * Return drug content per milligram of dose as exponential terms. With a
+ * peripheral compartment an intravenous dose declines bi-exponentially,
+ * A * exp(-alpha * t) + B * exp(-beta * t).
  *
- * @note: units are in hours
+ * @note: equal ka and ke are separated slightly
 */
-double TwoComp::computeAucDr(const DrugInfo& drug, const double& dose, const double& t)
+ExpTerms PK::computeDrugTerms(const DrugInfo& drug, COMP_MODEL model)
 {
-    if (!drug.isDr)
-        throw std::runtime_error("cannot compute dr auc: drug is not dr");
+    ExpTerms terms;
 
-    // Treat as single dose if delayed has not released.
-    if (t < *drug.drLagtime) {
-        return TwoComp::computeAuc(drug, dose, t);
-    }
+    if (drug.hasPeripheral) {
+        const auto [alpha, beta] = computeHybridRates(drug);
+        const double& k21 = drug.k21.value();
 
-    double irDose = dose * (1 - drug.drFrac.value());
-    double drT = t - drug.drLagtime.value();
+        terms.add((alpha - k21) / (drug.vd * (alpha - beta)), alpha);
+        terms.add((k21 - beta) / (drug.vd * (alpha - beta)), beta);
+    }
+    else {
+        const bool isEqualRate = model != ONE_COMP_MODEL && drug.ka == drug.ke;
+        terms.add(1.0 / drug.vd, isEqualRate ? drug.ke * EQUAL_RATE_MULT : drug.ke);
+    }
 
-    double result = TwoComp::computeAuc(drug, irDose, t);
-    result += TwoComp::computeAuc(drug, dose * drug.drFrac.value(), drT);
+    if (model == ONE_COMP_MODEL)
+        return terms;
 
-    return result;
+    return convolveTerms(terms, drug.ka, drug.bioavailability * drug.ka);
 }
 
 /*
- * Compute area under curve for metabolite in two compartment model.
+ * Return active drug content per milligram of prodrug as exponential terms,
+ * the prodrug eliminated from the central compartment forms the active drug
+ * (the Bateman equation of the prodrug chain without a peripheral one).
  *
- * @note: units are in hours
+ * @note: equal rates are separated slightly
 */
-double TwoComp::computeAucMetabolite(const DrugInfo& drug, const double& t)
+ExpTerms PK::computeActiveTerms(const DrugInfo& drug, COMP_MODEL model)
 {
-    if (!drug.isProdrug)
-        throw std::runtime_error("cannot compute auc for metabolite (no prodrug info)");
-
-    const double& ka = drug.ka;
-    const double& ke = drug.ke;
-    const double& km = drug.activeKe.value();
-    const float& bio = drug.bioavailability;
+    if (!drug.activeKe.has_value() || !drug.activeFrac.has_value()) {
+        throwInvalidArg("active drug from prodrug contains no info");
+    }
 
-    double auc = (1 - exp(-ka * t)) / ((ke - ka) * (km - ka) * ka);
-    auc += (1 - exp(-ke * t)) / ((ka - ke) * (km - ke) * ke);
-    auc += (1 - exp(-km * t)) / ((ka - km) * (ke - km) * km);
-    auc *= ka * ke * bio * drug.dose * drug.activeFrac.value();
+    /* https://en.wikipedia.org/wiki/Bateman_equation */
+    ExpTerms central = computeDrugTerms(drug, model);
+    for (std::size_t i = 0; i < central.size; ++i) central.coef[i] *= drug.vd;
 
-    return auc / 3600;
+    return convolveTerms(central, *drug.activeKe, *drug.activeFrac * drug.ke);
 }
 
 /*
@@ -330,3 +310,14 @@ double PK::computeEffectiveness(const double& midpoint, const double& dose)
 {
     return 1.0 / (1 + midpoint / dose);
 }
+
+/* Dense form of computeEffectiveness, out[i] is the effectiveness of dose[i]. */
+void PK::computeEffectiveness(double midpoint, std::span<const double> dose,
+                              std::span<double> out)
+{
+    checkKernelSpans(dose, out);
+
+    for (std::size_t i = 0; i < dose.size(); ++i) {
+        out[i] = 1.0 / (1 + midpoint / dose[i]);
+    }
+}
@@ -0,0 +1,397 @@
+#include <exception>
+#include <random>
+#include <thread>
+#include <algorithm>
+#include "pch.hpp"
+#include "population.hpp"
+#include "vec_math.hpp"
+#include "pk_utils.hpp"
+
+using std::exp;
+using std::log;
+using std::size_t;
+
+namespace
+{
+    constexpr size_t MAX_TERMS = ExpTerms::MAX_TERMS;
+
+    // Contents of subjects evaluated one at a time held at once (32 MiB).
+    constexpr size_t BLOCK_VALUES = size_t(1) << 22;
+
+    /*
+     * Per subject curves as sums of exponentials in structure of arrays form,
+     * content_i(t) = sum_k coef[k][i] * exp(-rate[k][i] * t).
+     *
+     * Delayed release adds drCoef with the same rates at t - drLag.
+    */
+    struct SubjectTerms {
+        size_t count = 0; // number of terms used
+        std::vector<double> coef[MAX_TERMS];
+        std::vector<double> rate[MAX_TERMS];
+        std::vector<double> drCoef[MAX_TERMS];
+        double drLag = 0;
+        bool isDr = false;
+    };
+
+    /* Sample value with log-normal variability, value is the median. */
+    double sampleLogNormal(std::mt19937_64& gen, std::normal_distribution<double>& z,
+                           double value, double cv)
+    {
+        if (cv <= 0)
+            return value;
+
+        const double omega = std::sqrt(log(1 + cv * cv));
+
+        return value * exp(omega * z(gen));
+    }
+
+    SubjectTerms buildTerms(const SimulationInfo& sim, const PopulationParams& params)
+    {
+        const auto& drug = sim.drugInfo;
+        const size_t n = params.size();
+
+        SubjectTerms terms;
+        terms.isDr = drug.isDr;
+        terms.drLag = drug.isDr ? drug.drLagtime.value() : 0;
+
+        DrugInfo subject = drug;
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            subject.ka = params.ka[i];
+            subject.ke = params.ke[i];
+            subject.vd = params.vd[i];
+            subject.bioavailability = params.bioavailability[i];
+
+            const ExpTerms curve = drug.isProdrug ?
+                                   PK::computeActiveTerms(subject, sim.compModel) :
+                                   PK::computeDrugTerms(subject, sim.compModel);
+
+            if (i == 0) {
+                terms.count = curve.size;
+                for (size_t k = 0; k < terms.count; ++k) {
+                    terms.coef[k].resize(n);
+                    terms.rate[k].resize(n);
+                }
+            }
+
+            for (size_t k = 0; k < terms.count; ++k) {
+                terms.coef[k][i] = curve.coef[k] * drug.dose;
+                terms.rate[k][i] = curve.rate[k];
+            }
+        }
+
+        if (!drug.isDr)
+            return terms;
+
+        /* Split each coefficient into its immediate and delayed portion. */
+        const double drFrac = drug.drFrac.value();
+
+        for (size_t k = 0; k < terms.count; ++k) {
+            terms.drCoef[k] = terms.coef[k];
+            for (size_t i = 0; i < n; ++i) {
+                terms.drCoef[k][i] *= drFrac;
+                terms.coef[k][i] *= 1 - drFrac;
+            }
+        }
+
+        return terms;
+    }
+
+    /* out[i] += sum_k coef[k][i] * exp(-rate[k][i] * t), scratch holds n values. */
+    void addTerms(const SubjectTerms& terms, const std::vector<double>* coef,
+                  double t, std::span<double> out, std::span<double> scratch)
+    {
+        const size_t n = out.size();
+
+        for (size_t k = 0; k < terms.count; ++k)
+        {
+            const double* rate = terms.rate[k].data();
+            const double* c = coef[k].data();
+
+            for (size_t i = 0; i < n; ++i) {
+                scratch[i] = -rate[i] * t;
+            }
+
+            VecMath::exp(scratch.data(), scratch.data(), n);
+
+            for (size_t i = 0; i < n; ++i) {
+                out[i] += c[i] * scratch[i];
+            }
+        }
+    }
+
+    /*
+     * Split count items between all cores, work(begin, end) runs on each chunk.
+     * An exception thrown by work is rethrown here once every chunk is done.
+    */
+    template <typename Fn>
+    void forEachChunk(size_t count, Fn work)
+    {
+        const size_t threadCount = std::clamp<size_t>(
+            std::thread::hardware_concurrency(), 1, count
+        );
+        const size_t chunk = (count + threadCount - 1) / threadCount;
+
+        std::vector<std::thread> threads;
+        std::vector<std::exception_ptr> errors(threadCount);
+        threads.reserve(threadCount);
+
+        for (size_t begin = 0, c = 0; begin < count; begin += chunk, ++c) {
+            threads.emplace_back([&, begin, c] {
+                try {
+                    work(begin, std::min(begin + chunk, count));
+                }
+                catch (...) {
+                    errors[c] = std::current_exception();
+                }
+            });
+        }
+
+        for (auto& it : threads) {
+            it.join();
+        }
+
+        for (const auto& it : errors) {
+            if (it) std::rethrow_exception(it);
+        }
+    }
+
+    /*
+     * Content of every subject of a nonlinear model at the time points of one
+     * block, content[j * n + i] is subject i at t[j]. Subjects are split
+     * between all cores, each resumes its integration from its cursor.
+    */
+    void simulateNonlinear(const SimulationInfo& sim, const PopulationParams& params,
+                           std::span<const double> t,
+                           std::span<NonlinearModel::Cursor> cursors,
+                           std::span<double> content)
+    {
+        const auto& drug = sim.drugInfo;
+        const size_t n = params.size();
+
+        forEachChunk(n, [&](size_t begin, size_t end) {
+            NonlinearModel model = sim.nonlinear.value();
+            const bool isBolus = model.ka == 0;
+
+            for (size_t i = begin; i < end; ++i)
+            {
+                // Elimination variability scales vmax, ke is its low content rate.
+                if (!isBolus) model.ka = params.ka[i];
+                if (!isBolus) model.doseScale = params.bioavailability[i];
+                model.vmax = *drug.vmax * params.ke[i] / drug.ke;
+                model.vd = params.vd[i];
+
+                for (size_t j = 0; j < t.size(); ++j) {
+                    const auto x = model.at(t[j], cursors[i]);
+                    content[j * n + i] = drug.isProdrug ?
+                                         x[LinearModel::STATE_ACTIVE] :
+                                         x[LinearModel::STATE_CENTRAL] / model.vd;
+                }
+            }
+        });
+    }
+
+    /*
+     * Dose schedule superimposed on each subject's own single dose curve
+     * (infusions included), infusions alone leave the dose at 0 so they need
+     * these too.
+    */
+    std::vector<RegimenCurve> buildRegimenCurves(const SimulationInfo& sim,
+                                                 const PopulationParams& params)
+    {
+        const auto& drug = sim.drugInfo;
+        std::vector<RegimenCurve> curves(params.size());
+
+        forEachChunk(curves.size(), [&](size_t begin, size_t end) {
+            DrugInfo subject = drug;
+
+            for (size_t i = begin; i < end; ++i)
+            {
+                subject.ka = params.ka[i];
+                subject.ke = params.ke[i];
+                subject.vd = params.vd[i];
+                subject.bioavailability = params.bioavailability[i];
+
+                curves[i] = makeRegimenCurve(subject, drug.isProdrug ?
+                    PK::computeActiveTerms(subject, sim.compModel) :
+                    PK::computeDrugTerms(subject, sim.compModel)
+                );
+            }
+        });
+
+        return curves;
+    }
+
+    /* Same as simulateNonlinear for every subject's dose schedule. */
+    void simulateRegimen(const std::vector<RegimenCurve>& curves, std::span<const double> t,
+                         std::span<double> content)
+    {
+        const size_t n = curves.size();
+
+        forEachChunk(n, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                for (size_t j = 0; j < t.size(); ++j) {
+                    content[j * n + i] = curves[i].value(t[j]);
+                }
+            }
+        });
+    }
+
+    /*
+     * Linearly interpolated percentiles of values, percentiles must be in
+     * ascending order. Each selection only searches past the previous one.
+    */
+    template <size_t N>
+    void percentilesOf(std::span<double> values, const double (&percentiles)[N],
+                       double (&out)[N])
+    {
+        auto first = values.begin();
+
+        for (size_t p = 0; p < N; ++p)
+        {
+            const double pos = percentiles[p] * (values.size() - 1);
+            const size_t lo = static_cast<size_t>(pos);
+            const double frac = pos - lo;
+            auto loIt = values.begin() + lo;
+
+            std::nth_element(first, loIt, values.end());
+            out[p] = *loIt;
+
+            if (frac > 0 && lo + 1 < values.size()) {
+                double next = *std::min_element(loIt + 1, values.end());
+                out[p] += frac * (next - out[p]);
+            }
+
+            first = loIt;
+        }
+    }
+}
+
+/*
+ * Sample virtual subjects around the drug's values, each value is log-normal
+ * with the drug value as median and the configured coefficient of variation.
+ *
+ * @note: bioavailability is capped at 1
+*/
+PopulationParams Population::sampleParams(const SimulationInfo& sim)
+{
+    const auto& drug = sim.drugInfo;
+    const auto& pop = sim.population.value();
+    const auto& cv = pop.cv;
+
+    std::mt19937_64 gen(pop.seed);
+    std::normal_distribution<double> z;
+    PopulationParams params;
+
+    params.ka.resize(pop.subjects);
+    params.ke.resize(pop.subjects);
+    params.vd.resize(pop.subjects);
+    params.bioavailability.resize(pop.subjects);
+
+    for (size_t i = 0; i < pop.subjects; ++i)
+    {
+        double& ka = params.ka[i];
+        double& ke = params.ke[i];
+
+        ka = drug.ka > 0 ? sampleLogNormal(gen, z, drug.ka, cv[0]) : drug.ka;
+        ke = sampleLogNormal(gen, z, drug.ke, cv[1]);
+        params.vd[i] = sampleLogNormal(gen, z, drug.vd, cv[2]);
+        params.bioavailability[i] = std::min(
+            sampleLogNormal(gen, z, drug.bioavailability, cv[3]), 1.0
+        );
+
+        /* Same flip-flop handling as the single subject simulation. */
+        if (ka > 0 && ka < ke && !drug.hasPeripheral && !drug.isNonlinear) {
+            std::swap(ka, ke);
+        }
+    }
+
+    return params;
+}
+
+/*
+ * Simulate every subject at each time point and reduce to percentile bands.
+ * Time points are split between all cores, each core evaluates every subject
+ * of its time points at once. Nonlinear models and dose schedules are
+ * evaluated per subject instead, block by block of time points so memory does
+ * not grow with their number.
+*/
+PopulationBands Population::simulate(const SimulationInfo& sim,
+                                     const PopulationParams& params,
+                                     std::span<const double> t)
+{
+    const size_t subjects = params.size();
+
+    PopulationBands bands;
+    for (auto& it : bands.band) {
+        it.resize(t.size());
+    }
+
+    if (subjects == 0 || t.empty())
+        return bands;
+
+    if (sim.nonlinear.has_value() || sim.regimen.has_value())
+    {
+        const bool isNonlinear = sim.nonlinear.has_value();
+
+        // Only the contents of one block of time points are held at once.
+        const size_t block = std::clamp<size_t>(BLOCK_VALUES / subjects, 1, t.size());
+        std::vector<double> content(subjects * block);
+
+        std::vector<NonlinearModel::Cursor> cursors(isNonlinear ? subjects : 0);
+        const auto curves = isNonlinear ? std::vector<RegimenCurve>{} :
+                                          buildRegimenCurves(sim, params);
+
+        for (size_t first = 0; first < t.size(); first += block)
+        {
+            const auto times = t.subspan(first, std::min(block, t.size() - first));
+
+            if (isNonlinear) simulateNonlinear(sim, params, times, cursors, content);
+            else simulateRegimen(curves, times, content);
+
+            forEachChunk(times.size(), [&](size_t begin, size_t end) {
+                for (size_t j = begin; j < end; ++j)
+                {
+                    double values[std::size(POPULATION_PERCENTILES)];
+                    percentilesOf(std::span(content).subspan(j * subjects, subjects),
+                                  POPULATION_PERCENTILES, values);
+
+                    for (size_t p = 0; p < std::size(values); ++p) {
+                        bands.band[p][first + j] = values[p];
+                    }
+                }
+            });
+        }
+
+        return bands;
+    }
+
+    const SubjectTerms terms = buildTerms(sim, params);
+
+    auto work = [&](size_t begin, size_t end) {
+        std::vector<double> content(subjects);
+        std::vector<double> scratch(subjects);
+
+        for (size_t j = begin; j < end; ++j)
+        {
+            std::fill(content.begin(), content.end(), 0.0);
+            addTerms(terms, terms.coef, t[j], content, scratch);
+
+            if (terms.isDr && t[j] >= terms.drLag) {
+                addTerms(terms, terms.drCoef, t[j] - terms.drLag, content, scratch);
+            }
+
+            double values[std::size(POPULATION_PERCENTILES)];
+            percentilesOf(content, POPULATION_PERCENTILES, values);
+
+            for (size_t p = 0; p < std::size(values); ++p) {
+                bands.band[p][j] = values[p];
+            }
+        }
+    };
+
+    forEachChunk(t.size(), work);
+
+    return bands;
+}
@@ -0,0 +1,286 @@
+#include <algorithm>
+#include <limits>
+#include "pch.hpp"
+#include "regimen.hpp"
+
+using std::exp;
+using std::expm1;
+using std::size_t;
+
+namespace
+{
+    constexpr size_t NO_DOSE = std::numeric_limits<size_t>::max();
+
+    /* Number of doses of the train given by time t. */
+    double dosesGiven(const DoseTrain& train, double t)
+    {
+        if (t < train.start)
+            return 0;
+        else if (train.interval <= 0)
+            return static_cast<double>(train.count);
+
+        double n = std::floor((t - train.start) / train.interval) + 1;
+
+        return std::min(n, static_cast<double>(train.count));
+    }
+
+    /*
+     * Sum of exp(-k * (t - t_i)) over m doses spaced by interval, where the
+     * last dose was sinceLast ago.
+    */
+    double geometricSum(double k, double sinceLast, double interval, double m)
+    {
+        if (interval <= 0 || m == 1)
+            return m * exp(-k * sinceLast);
+
+        double x = k * interval;
+
+        return exp(-k * sinceLast) * expm1(-m * x) / expm1(-x);
+    }
+
+    /* Index of the last irregular dose given by time t, or NO_DOSE if none. */
+    size_t lastDoseIndex(const std::vector<double>& times, double t)
+    {
+        auto it = std::upper_bound(times.begin(), times.end(), t);
+        return it == times.begin() ? NO_DOSE : it - times.begin() - 1;
+    }
+}
+
+/*
+ * Sum of dose * exp(-rate * (t - t_i)) of each term over every dose given
+ * by time t. Infusions are the same sum integrated over their doses, each
+ * rate change c at t_i adds c / k * (1 - exp(-k * (t - t_i))).
+*/
+RegimenCurve::TermSums RegimenCurve::sumsAt(double t) const
+{
+    TermSums sums;
+
+    const size_t r = lastDoseIndex(rateTimes, t);
+    if (r != NO_DOSE)
+    {
+        const double since = t - rateTimes[r];
+
+        for (size_t k = 0; k < terms.size; ++k) {
+            const double rate = terms.rate[k];
+            sums.decayed[k] += (infusionRate[r] - rateRunning[r][k] * exp(-rate * since)) / rate;
+        }
+        sums.given += infused[r] + infusionRate[r] * since;
+    }
+
+    for (const auto& train : trains)
+    {
+        const double m = dosesGiven(train, t);
+        if (m == 0)
+            continue;
+
+        const double interval = train.interval > 0 ? train.interval : 0;
+        const double sinceLast = t - (train.start + (m - 1) * interval);
+
+        for (size_t k = 0; k < terms.size; ++k) {
+            sums.decayed[k] += train.dose *
+                               geometricSum(terms.rate[k], sinceLast, interval, m);
+        }
+        sums.given += train.dose * m;
+    }
+
+    const size_t j = lastDoseIndex(times, t);
+    if (j == NO_DOSE)
+        return sums;
+
+    for (size_t k = 0; k < terms.size; ++k) {
+        sums.decayed[k] += running[j][k] * exp(-terms.rate[k] * (t - times[j]));
+    }
+    sums.given += cumulativeDose[j];
+
+    return sums;
+}
+
+/* Drug content of the whole schedule at time t. */
+double RegimenCurve::value(double t) const
+{
+    const auto sums = sumsAt(t);
+    double sum = 0.0;
+
+    for (size_t k = 0; k < terms.size; ++k) {
+        sum += terms.coef[k] * sums.decayed[k];
+    }
+
+    return sum;
+}
+
+/* Area under the schedule's curve from 0 to t. */
+double RegimenCurve::integral(double t) const
+{
+    const auto sums = sumsAt(t);
+    double sum = 0.0;
+
+    for (size_t k = 0; k < terms.size; ++k) {
+        sum += terms.coef[k] / terms.rate[k] * (sums.given - sums.decayed[k]);
+    }
+
+    return sum;
+}
+
+/*
+ * Return the curve after time t as terms of the time since t, assuming no
+ * more doses are given.
+*/
+ExpTerms RegimenCurve::termsAt(double t) const
+{
+    const auto sums = sumsAt(t);
+    ExpTerms result = terms;
+
+    for (size_t k = 0; k < terms.size; ++k) {
+        result.coef[k] *= sums.decayed[k];
+    }
+
+    return result;
+}
+
+/*
+ * Time of the final dose or the end of the final infusion, infinite if doses
+ * are repeated indefinitely.
+*/
+double RegimenCurve::lastDoseTime() const
+{
+    double last = times.empty() ? 0.0 : times.back();
+
+    for (const auto& infusion : infusions) {
+        last = std::max(last, infusion.start + infusion.duration);
+    }
+
+    for (const auto& train : trains)
+    {
+        if (train.interval <= 0) {
+            last = std::max(last, train.start);
+        }
+        else if (train.count == std::numeric_limits<size_t>::max()) {
+            return std::numeric_limits<double>::infinity();
+        }
+        else {
+            last = std::max(last, train.start + (train.count - 1) * train.interval);
+        }
+    }
+
+    return last;
+}
+
+/*
+ * Build the schedule of drug onto a single dose curve, each dose is split into
+ * its immediate and delayed portion if delayed release is used.
+*/
+RegimenCurve makeRegimenCurve(const DrugInfo& drug, const ExpTerms& unitCurve)
+{
+    const auto& schedule = drug.schedule.value();
+
+    const double drFrac = drug.isDr ? drug.drFrac.value() : 0.0;
+    const double drLag = drug.isDr ? drug.drLagtime.value() : 0.0;
+
+    RegimenCurve curve;
+    curve.terms = unitCurve;
+    curve.infusions = schedule.infusions;
+
+    std::vector<std::pair<double, double>> doses; // irregular {time, dose}
+
+    auto addTrain = [&](double interval, size_t count, double dose) {
+        curve.trains.push_back({0, interval, count, dose * (1 - drFrac)});
+        if (drug.isDr) {
+            curve.trains.push_back({drLag, interval, count, dose * drFrac});
+        }
+    };
+
+    auto addDose = [&](double t, double dose) {
+        doses.emplace_back(t, dose * (1 - drFrac));
+        if (drug.isDr) {
+            doses.emplace_back(t + drLag, dose * drFrac);
+        }
+    };
+
+    if (schedule.interval > 0) {
+        addTrain(schedule.interval, schedule.count, drug.dose);
+    } else {
+        addTrain(0, 1, drug.dose);
+    }
+
+    // Loading dose replaces the first dose, add the difference.
+    if (schedule.loadingDose.has_value()) {
+        addDose(0, *schedule.loadingDose - drug.dose);
+    }
+
+    for (const auto& it : schedule.extraDoses) {
+        addDose(it.first, it.second);
+    }
+
+    std::stable_sort(doses.begin(), doses.end(), [](auto& a, auto& b) {
+            return a.first < b.first;
+    });
+
+    /* Fold each dose into the running sum of every term. */
+    std::array<double, ExpTerms::MAX_TERMS> sum{};
+    double cumulative = 0.0;
+
+    for (size_t j = 0; j < doses.size(); ++j)
+    {
+        const auto& [t, dose] = doses[j];
+
+        if (j > 0) {
+            const double dt = t - doses[j - 1].first;
+            for (size_t k = 0; k < unitCurve.size; ++k) {
+                sum[k] *= exp(-unitCurve.rate[k] * dt);
+            }
+        }
+
+        for (size_t k = 0; k < unitCurve.size; ++k) {
+            sum[k] += dose;
+        }
+        cumulative += dose;
+
+        curve.times.push_back(t);
+        curve.cumulativeDose.push_back(cumulative);
+        curve.running.push_back(sum);
+    }
+
+    /* Fold each start and end of an infusion in the same way, {time, rate change}. */
+    std::vector<std::pair<double, double>> changes;
+    for (const auto& it : schedule.infusions) {
+        changes.emplace_back(it.start, it.rate);
+        changes.emplace_back(it.start + it.duration, -it.rate);
+    }
+
+    std::stable_sort(changes.begin(), changes.end(), [](auto& a, auto& b) {
+            return a.first < b.first;
+    });
+
+    sum = {};
+    double rate = 0.0;
+    double amount = 0.0;
+    size_t running = 0;
+
+    for (size_t j = 0; j < changes.size(); ++j)
+    {
+        const auto& [t, change] = changes[j];
+
+        if (j > 0) {
+            const double dt = t - changes[j - 1].first;
+            for (size_t k = 0; k < unitCurve.size; ++k) {
+                sum[k] *= exp(-unitCurve.rate[k] * dt);
+            }
+            amount += rate * dt;
+        }
+
+        for (size_t k = 0; k < unitCurve.size; ++k) {
+            sum[k] += change;
+        }
+
+        // Exactly 0 once every infusion ended, not what is left of rounding.
+        running = change > 0 ? running + 1 : running - 1;
+        rate = running > 0 ? rate + change : 0.0;
+
+        curve.rateTimes.push_back(t);
+        curve.infusionRate.push_back(rate);
+        curve.infused.push_back(amount);
+        curve.rateRunning.push_back(sum);
+    }
+
+    return curve;
+}
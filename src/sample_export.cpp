@@ -0,0 +1,82 @@
+#include <unistd.h>
+#include "pch.hpp"
+#include "sample_export.hpp"
+#include "simulation_helper.hpp"
+#include "io_utils.hpp"
+
+SampleExporter::SampleExporter(const std::string& path)
+    : fd(IoUtils::openOutput(path))
+{
+    if (path.ends_with(".tsv")) {
+        delim = '\t';
+    }
+    buffer.reserve(BLOCK_SIZE + RenderBuffer::CAPACITY);
+}
+
+SampleExporter::~SampleExporter()
+{
+    // Rows left after an error are dropped, flush() reports write errors.
+    if (fd > STDERR_FILENO) {
+        ::close(fd);
+    }
+}
+
+void SampleExporter::writeHeader()
+{
+    const char* names[] = {"elapsed", "drug_content", "active_drug_content",
+                           "excreted", "auc", "effectiveness", "phase", "dr_phase"};
+
+    row.clear();
+    for (const char* name : names) {
+        if (!row.empty()) row += delim;
+        row += name;
+    }
+    row += '\n';
+
+    buffer += row.view();
+}
+
+/* Buffer the current sample of sim, written once a block is full. */
+void SampleExporter::write(const SimulationInfo& sim)
+{
+    const auto& drug = sim.drugInfo;
+    const auto& state = sim.state;
+
+    /* Labels contain commas, CSV quotes them. */
+    auto appendLabel = [&](std::string_view label) {
+        if (delim == ',') row += '"';
+        row += label;
+        if (delim == ',') row += '"';
+    };
+
+    row.clear();
+
+    row.appendChars(state.elapsed);
+    row += delim;
+    row.appendChars(state.drugContent);
+    row += delim;
+    if (drug.isProdrug) row.appendChars(state.activeDrugContent.value());
+    row += delim;
+    if (sim.displayExcreted) row.appendChars(state.excreted);
+    row += delim;
+    row.appendChars(state.auc);
+    row += delim;
+    if (sim.ed50Enabled) row.appendChars(state.effectiveness);
+    row += delim;
+    appendLabel(SimHelper::getPhaseLabel(sim));
+    row += delim;
+    if (drug.isDr) appendLabel(SimHelper::getDrPhaseLabel(sim));
+    row += '\n';
+
+    buffer += row.view();
+
+    if (buffer.size() >= BLOCK_SIZE) {
+        flush();
+    }
+}
+
+void SampleExporter::flush()
+{
+    IoUtils::writeAll(fd, buffer.data(), buffer.size());
+    buffer.clear();
+}
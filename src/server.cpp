@@ -0,0 +1,458 @@
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "json.hpp"
+#include "pch.hpp"
+#include "server.hpp"
+#include "input_handler.hpp"
+#include "simulation_helper.hpp"
+#include "drugsim.hpp"
+#include "io_utils.hpp"
+
+using std::string;
+using json = nlohmann::json;
+
+namespace
+{
+    const std::size_t readSize = 1 << 16;
+    const std::size_t maxQuerySize = 1 << 20; // longest line accepted
+
+    struct Connection {
+        int fd;
+        string pending;         // received text after the last complete line
+        string outgoing;        // replies the socket has not taken yet
+        bool isBusy = false;    // handed to a worker, not polled
+        bool isClosed = false;
+    };
+
+    /*
+     * Connections with data to read are handed from the polling thread to the
+     * workers, and back once every complete line is answered.
+    */
+    struct ConnectionQueue {
+        std::mutex mutex;
+        std::condition_variable hasWork;
+        std::deque<Connection*> readable;
+        std::vector<Connection*> returned;
+        int wakeFd;             // written to when connections are returned
+        bool isStopped = false; // workers return once set
+    };
+
+    [[noreturn]] void throwSystemError(const string& what)
+    {
+        throw std::runtime_error(what + ": " + std::strerror(errno));
+    }
+
+    sockaddr_un makeAddress(const string& path)
+    {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            throw std::invalid_argument("invalid socket path: " + path);
+        }
+        path.copy(addr.sun_path, path.size());
+
+        return addr;
+    }
+
+    int connectTo(const string& path)
+    {
+        const sockaddr_un addr = makeAddress(path);
+
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            throwSystemError("cannot create socket");
+        }
+
+        if (::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+            ::close(fd);
+            return -1;
+        }
+
+        return fd;
+    }
+
+    int listenOn(const string& path)
+    {
+        const sockaddr_un addr = makeAddress(path);
+
+        // A socket left behind by a stopped server is replaced, other files are not.
+        struct stat st;
+        if (::lstat(path.c_str(), &st) == 0)
+        {
+            if (!S_ISSOCK(st.st_mode)) {
+                throw std::invalid_argument("'" + path + "' exists and is not a socket");
+            }
+
+            int fd = connectTo(path);
+            if (fd >= 0) {
+                ::close(fd);
+                throw std::invalid_argument("a server is already listening on '" + path + "'");
+            }
+            ::unlink(path.c_str());
+        }
+
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            throwSystemError("cannot create socket");
+        }
+
+        if (::bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+            throwSystemError("cannot bind '" + path + "'");
+        }
+        if (::listen(fd, SOMAXCONN) != 0) {
+            throwSystemError("cannot listen on '" + path + "'");
+        }
+
+        return fd;
+    }
+
+    const Args::Metadata& findConfigArg(const string& key)
+    {
+        for (const auto& it : configArgs) {
+            if (it.second == key)
+                return *it.first;
+        }
+
+        throw std::invalid_argument("unknown key: " + key);
+    }
+
+    json answerQuery(const json& query, const ArgParser& defaults)
+    {
+        json reply = json::object();
+
+        try
+        {
+            if (query.contains("id")) {
+                reply["id"] = query["id"];
+            }
+
+            ArgParser parser = defaults;
+
+            for (const auto& [key, value] : query.items())
+            {
+                if (key == "id" || key == "times")
+                    continue;
+
+                parser.getArg(findConfigArg(key)).value =
+                    value.is_string() ? value.get<string>() : value.dump();
+            }
+
+            SimulationInfo sim;
+            handleInput(parser, sim, false);
+            SimHelper::validateInit(sim);
+
+            const auto times = query.at("times").get<std::vector<double>>();
+            const auto samples = DrugSim::evaluate(sim, times);
+
+            reply["drug_content"] = samples.drugContent;
+            if (!samples.activeDrugContent.empty())
+                reply["active_drug_content"] = samples.activeDrugContent;
+            if (!samples.excreted.empty())
+                reply["excreted"] = samples.excreted;
+            reply["auc"] = samples.auc;
+            if (!samples.effectiveness.empty())
+                reply["effectiveness"] = samples.effectiveness;
+            reply["completion"] = sim.events.completion;
+        }
+        catch (const std::exception& e) {
+            reply["error"] = e.what();
+        }
+
+        return reply;
+    }
+
+    string answerLine(std::string_view line, const ArgParser& defaults)
+    {
+        json reply;
+
+        try
+        {
+            const json request = json::parse(line);
+
+            if (request.is_array()) {
+                reply = json::array();
+                for (const auto& query : request) {
+                    reply.push_back(answerQuery(query, defaults));
+                }
+            }
+            else {
+                reply = answerQuery(request, defaults);
+            }
+        }
+        catch (const json::exception& e) {
+            reply = {{"error", e.what()}};
+        }
+
+        // Non-finite values (e.g. an unreachable completion) are written as null.
+        return reply.dump(-1, ' ', false, json::error_handler_t::replace) + '\n';
+    }
+
+    /*
+     * Write as much of the outgoing replies as the socket takes without
+     * blocking, returns false if the connection failed.
+    */
+    bool flushOutgoing(Connection& conn)
+    {
+        while (!conn.outgoing.empty())
+        {
+            const ssize_t n = ::send(conn.fd, conn.outgoing.data(), conn.outgoing.size(),
+                                     MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            conn.outgoing.erase(0, n);
+        }
+        return true;
+    }
+
+    /* Read what is available and answer every complete line. */
+    void serveConnection(Connection& conn, const ArgParser& defaults)
+    {
+        char chunk[readSize];
+        ssize_t n;
+
+        do {
+            n = ::read(conn.fd, chunk, sizeof(chunk));
+        } while (n < 0 && errno == EINTR);
+
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+
+        if (n <= 0) {
+            conn.isClosed = true;
+            return;
+        }
+        conn.pending.append(chunk, n);
+
+        string replies;
+        std::size_t start = 0;
+
+        for (std::size_t end; (end = conn.pending.find('\n', start)) != string::npos; start = end + 1)
+        {
+            const std::string_view line(conn.pending.data() + start, end - start);
+
+            if (line.find_first_not_of(" \t\r") != std::string_view::npos) {
+                replies += answerLine(line, defaults);
+            }
+        }
+        conn.pending.erase(0, start);
+
+        if (conn.pending.size() > maxQuerySize) {
+            replies += json{{"error", "query is too long"}}.dump() + '\n';
+            conn.isClosed = true;
+        }
+
+        // Whatever the client does not read now is sent by the polling thread.
+        conn.outgoing += replies;
+        if (!flushOutgoing(conn)) {
+            conn.isClosed = true;
+        }
+    }
+
+    void runWorker(ConnectionQueue& queue, const ArgParser& defaults)
+    {
+        while (true)
+        {
+            Connection* conn;
+            {
+                std::unique_lock lock(queue.mutex);
+                queue.hasWork.wait(lock, [&] {
+                    return !queue.readable.empty() || queue.isStopped;
+                });
+                if (queue.isStopped)
+                    return;
+
+                conn = queue.readable.front();
+                queue.readable.pop_front();
+            }
+
+            serveConnection(*conn, defaults);
+
+            {
+                std::lock_guard lock(queue.mutex);
+                queue.returned.push_back(conn);
+            }
+
+            const char wake = 0;
+            while (::write(queue.wakeFd, &wake, 1) < 0 && errno == EINTR);
+        }
+    }
+
+    /* Workers of a queue, stopped and joined when the server stops (e.g. poll fails). */
+    struct WorkerPool {
+        ConnectionQueue& queue;
+        std::vector<std::thread> threads;
+
+        ~WorkerPool() {
+            {
+                std::lock_guard lock(queue.mutex);
+                queue.isStopped = true;
+            }
+            queue.hasWork.notify_all();
+
+            for (auto& it : threads) {
+                it.join();
+            }
+        }
+    };
+}
+
+/*
+ * Answer queries until the process is stopped. One thread polls the socket
+ * and every idle connection, readable connections are answered by a pool of
+ * workers so long lived connections do not hold a thread while idle.
+ *
+ * Sockets are non-blocking. Replies a client has not read yet stay on its
+ * connection and are sent by the polling thread, which reads no more of that
+ * client's queries until they are, so clients that never read hold no worker.
+*/
+void startServer(const ArgParser& defaults, const string& path)
+{
+    // Clients closing early must not stop the server.
+    std::signal(SIGPIPE, SIG_IGN);
+
+    const int listenFd = listenOn(path);
+
+    int wakePipe[2];
+    if (::pipe2(wakePipe, O_CLOEXEC) != 0) {
+        throwSystemError("cannot create pipe");
+    }
+
+    ConnectionQueue queue;
+    queue.wakeFd = wakePipe[1];
+
+    // Declared before the workers, so destroyed after they are joined.
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;
+    std::vector<pollfd> fds;
+
+    const unsigned workerCount = std::max(2u, std::thread::hardware_concurrency());
+
+    WorkerPool workers{queue};
+    for (unsigned i = 0; i < workerCount; ++i) {
+        workers.threads.emplace_back(runWorker, std::ref(queue), std::cref(defaults));
+    }
+
+    std::cerr << std::format("listening on {} with {} workers\n", path, workerCount);
+
+    while (true)
+    {
+        fds.clear();
+        fds.push_back({listenFd, POLLIN, 0});
+        fds.push_back({wakePipe[0], POLLIN, 0});
+
+        for (const auto& [fd, conn] : connections) {
+            const short events = conn->outgoing.empty() ? POLLIN : POLLOUT;
+            if (!conn->isBusy) fds.push_back({fd, events, 0});
+        }
+
+        if (::poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            throwSystemError("poll failed");
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            if (fd >= 0) connections.emplace(fd, std::make_unique<Connection>(Connection{fd}));
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            char drain[256];
+            while (::read(wakePipe[0], drain, sizeof(drain)) < 0 && errno == EINTR);
+
+            std::lock_guard lock(queue.mutex);
+
+            for (Connection* conn : queue.returned) {
+                if (conn->isClosed) {
+                    ::close(conn->fd);
+                    connections.erase(conn->fd);
+                } else {
+                    conn->isBusy = false;
+                }
+            }
+            queue.returned.clear();
+        }
+
+        bool hasWork = false;
+
+        for (std::size_t i = 2; i < fds.size(); ++i)
+        {
+            if (!fds[i].revents)
+                continue;
+
+            auto& conn = connections.at(fds[i].fd);
+
+            // Waiting for the client to read its replies.
+            if (!conn->outgoing.empty())
+            {
+                if ((fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) || !flushOutgoing(*conn)) {
+                    ::close(conn->fd);
+                    connections.erase(fds[i].fd);
+                }
+                continue;
+            }
+
+            conn->isBusy = true;
+            hasWork = true;
+
+            std::lock_guard lock(queue.mutex);
+            queue.readable.push_back(conn.get());
+        }
+
+        if (hasWork) queue.hasWork.notify_all();
+    }
+}
+
+/* Send standard input to a server and print its replies. */
+void startClient(const string& path)
+{
+    std::signal(SIGPIPE, SIG_IGN);
+
+    const int fd = connectTo(path);
+    if (fd < 0) {
+        throwSystemError("cannot connect to '" + path + "'");
+    }
+
+    // Queries are sent while replies are read, so they are pipelined.
+    std::thread sender([fd] {
+        char chunk[readSize];
+        ssize_t n;
+
+        try {
+            while ((n = ::read(STDIN_FILENO, chunk, sizeof(chunk))) != 0) {
+                if (n < 0 && errno == EINTR) continue;
+                else if (n < 0) break;
+                IoUtils::writeAll(fd, chunk, n);
+            }
+        }
+        catch (const std::runtime_error&) {}
+
+        ::shutdown(fd, SHUT_WR);
+    });
+
+    char chunk[readSize];
+    ssize_t n;
+
+    while ((n = ::read(fd, chunk, sizeof(chunk))) != 0) {
+        if (n < 0 && errno == EINTR) continue;
+        else if (n < 0) break;
+        IoUtils::writeAll(STDOUT_FILENO, chunk, n);
+    }
+
+    sender.join();
+    ::close(fd);
+}
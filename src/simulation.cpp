@@ -1,22 +1,34 @@
+#include <csignal>
 #include "pch.hpp"
 #include "simulation.hpp"
 #include "simulation_helper.hpp"
 #include "time_utils.hpp"
 #include "convert_utils.hpp"
+#include "population.hpp"
+#include "combined.hpp"
+#include "pk_utils.hpp"
+#include "alloc_counter.hpp"
+#include "frame_renderer.hpp"
+#include "sample_export.hpp"
+#include "column_file.hpp"
+#include "tick_profiler.hpp"
+#include "steady_state.hpp"
 
 using std::getchar;
 using std::string;
+using std::string_view;
 
-const int tickIntervalMs = 50;
+const std::size_t batchFlushSize = 1 << 16; // bytes buffered before writing
 
-void startLag(SimulationInfo&);
+volatile std::sig_atomic_t isInterrupted = 0;  // Ctrl-C during a profiled run
+
+void startLag(SimulationInfo&, SimClock&);
 void printStartupText(SimulationInfo&);
-void displayOutput(SimulationInfo&);
+void stageOutput(const SimulationInfo&, FrameRenderer&);
+void reportAllocs(std::size_t allocs, std::size_t ticks);
+void writeBatchColumns(SimulationInfo&);
+void startClock(SimulationInfo&, std::chrono::duration<double> now = getEpoch());
 
-/* Ansi codes with carriage return before them */
-const string lineReset = '\r' + ANSI_CLEAR;
-const string lineDown = '\r' + ANSI_DOWN;
-const string lineUp = '\r' + ANSI_UP;
 
 void startSimulation(SimulationInfo& simInfo)
 {
@@ -24,40 +36,80 @@ void startSimulation(SimulationInfo& simInfo)
 
     /* Startup stuff */
     validateInit(simInfo);
+
+    SimClock clock(simInfo.clockMode, simInfo.clockSpeed, simInfo.tickRate);
+    startClock(simInfo, clock.origin);
     printStartupText(simInfo);
 
     // Start lagtime if needed.
-    startLag(simInfo);
+    startLag(simInfo, clock);
 
     /* Aliases to prevent ugly code */
     auto& drug = simInfo.drugInfo;
     auto& simState = simInfo.state;
 
     /* Get time since drug reached systemic circulation */
-    auto getElapsed = [&]() { return (getEpoch() - simInfo.epoch).count(); };
+    auto getElapsed = [&]() { return clock.since(simInfo.epoch); };
 
     double& elapsed = simState.elapsed;
 
+    // Prodrug output keeps its second line even once it is no longer shown.
+    FrameRenderer renderer(simState.isMultiline ? 2 : 1);
+    std::flush(std::cout);
+
+    /* Samples are exported every tick, written out about once per second. */
+    std::optional<SampleExporter> exporter;
+    const std::size_t exportFlushTicks = std::ceil(simInfo.tickRate);
+
+    if (simInfo.exportPath.has_value()) {
+        if (*simInfo.exportPath == "-" || isColumnFilePath(*simInfo.exportPath)) {
+            throw std::invalid_argument("export to standard output or .bin requires batch mode");
+        }
+        exporter.emplace(*simInfo.exportPath);
+        exporter->writeHeader();
+    }
+
+    // Profiled runs stopped with Ctrl-C still report the profile.
+    TickProfiler profiler(simInfo.isProfileEnabled);
+    if (simInfo.isProfileEnabled) {
+        std::signal(SIGINT, [](int) { isInterrupted = 1; });
+    }
+
+    const std::size_t allocStart = AllocCounter::count();
+    std::size_t ticks = 0;
+
     while (true)
     {
+        ++ticks;
+        profiler.startTick();
         elapsed = getElapsed();
 
         /* Update doses. */
         updateCurrentDoses(simInfo);
+        profiler.mark(PROFILE_UPDATE_DOSES);
 
         /* Has delayed release started? */
-        if (drug.isDr && !simState.hasDrReleased && elapsed >= drug.drLagtime.value()) {
-            simState.hasDrReleased = true;
-        }
+        checkDrReleased(simInfo);
+        profiler.restart();
 
         checkMaxAchieved(simInfo);
+        profiler.mark(PROFILE_CHECK_MAX);
 
         useFixedPrecision(simInfo);
+        profiler.mark(PROFILE_FIXED_PRECISION);
 
         updateCache(simInfo);
+        profiler.mark(PROFILE_UPDATE_CACHE);
+
+        // Nothing is written if the text has not changed.
+        stageOutput(simInfo, renderer);
+        renderer.present();
+        profiler.mark(PROFILE_DISPLAY);
 
-        displayOutput(simInfo);
-        std::flush(std::cout);
+        if (exporter) {
+            exporter->write(simInfo);
+            if (ticks % exportFlushTicks == 0) exporter->flush();
+        }
 
         // If the drug is not considered absorbed, check again.
         checkFullyAbsorbed(simInfo);
@@ -65,12 +117,30 @@ void startSimulation(SimulationInfo& simInfo)
         // Set drug tmax state to true if drug has reached tmax.
         checkTmaxState(simInfo);
 
-        // Break the loop if the minimum dose has been reached or all numbers are 0.
-        if (simState.fullyAbsorbed && isMinDose(simInfo)) {
+        // Break the loop once the precomputed completion time has passed.
+        if (isComplete(simInfo) || isInterrupted) {
             break;
         }
 
-        sleepFor(tickIntervalMs); // small delay before repeating
+        profiler.endTick();
+        clock.wait(); // sleep until the next tick
+        profiler.mark(PROFILE_SLEEP);
+    }
+
+    const std::size_t allocEnd = AllocCounter::count();
+
+    if (simInfo.isProfileEnabled) {
+        std::signal(SIGINT, SIG_DFL);
+    }
+
+    if (exporter) {
+        exporter->flush();
+    }
+
+    if (isInterrupted) {
+        std::cout << "\n\n";
+        profiler.report(std::cerr);
+        return;
     }
 
     elapsed = getElapsed();
@@ -83,29 +153,540 @@ void startSimulation(SimulationInfo& simInfo)
     getchar();
 
     std::cout << "\n";
+
+    if (simInfo.isAllocReportEnabled) {
+        reportAllocs(allocEnd - allocStart, ticks);
+    }
+
+    profiler.report(std::cerr);
 }
 
-void startLag(SimulationInfo& sim)
+/*
+ * Run several simulations in one loop and display them as a dashboard, each
+ * simulation has a title line followed by its output line(s). The summed
+ * active drug of every simulation is shown last if showCombined is set.
+*/
+void startMultiSimulation(std::vector<SimulationInfo>& sims, bool showCombined)
 {
-    if (sim.drugInfo.lagtime <= 0)
+    using namespace SimHelper;
+
+    struct Panel {
+        string title;
+        RenderBuffer status;      // replaces output once complete or lagging
+        std::size_t lines = 2;
+        std::size_t firstLine = 0;  // line of the title in the dashboard
+        bool isDone = false;
+    };
+
+    std::vector<Panel> panels(sims.size());
+    std::size_t totalLines = 0;
+    double tickRate = 0;
+
+    for (const auto& sim : sims) {
+        tickRate = std::max(tickRate, sim.tickRate);
+    }
+
+    // Every config is given the same clock settings.
+    SimClock clock(sims.front().clockMode, sims.front().clockSpeed, tickRate);
+
+    for (std::size_t i = 0; i < sims.size(); ++i)
+    {
+        auto& sim = sims[i];
+        auto& panel = panels[i];
+
+        validateInit(sim);
+        startClock(sim, clock.origin);
+
+        panel.title = sim.msg.value_or(std::format("simulation {}", i + 1));
+        panel.title += " (administered ";
+        panel.title += getTimeAndDateString(sim.epoch, sim.is12HrFormat);
+        panel.title += ')';
+        panel.lines = sim.drugInfo.isProdrug ? 3 : 2;
+
+        // Lagtime is shown in the panel instead of a blocking countdown.
+        sim.epoch += std::chrono::duration<double>(sim.drugInfo.lagtime);
+
+        totalLines += panel.lines;
+    }
+
+    /* Summed active drug, simulations which are lagging or done add nothing. */
+    const std::string_view combinedUnit = showCombined ? Combined::sharedUnit(sims) : "";
+    const double combinedEd50 = showCombined ? Combined::sharedEd50(sims) : 0;
+    int combinedPrecision = 0;
+
+    if (showCombined) {
+        for (const auto& sim : sims) {
+            combinedPrecision = std::max(combinedPrecision, sim.precision);
+        }
+        totalLines += 2;
+    }
+
+    /* Fixed number of lines per panel so the layout never shifts. */
+    FrameRenderer renderer(totalLines);
+    std::size_t line = 0;
+
+    for (auto& panel : panels) {
+        panel.firstLine = line;
+        renderer.line(line) += panel.title;
+        line += panel.lines;
+    }
+    if (showCombined) {
+        renderer.line(line) += "combined";
+    }
+
+    std::cout << '\n' << std::flush;
+
+    const std::size_t allocStart = AllocCounter::count();
+    std::size_t ticks = 0;
+
+    while (true)
+    {
+        ++ticks;
+        bool allDone = true;
+
+        for (std::size_t i = 0; i < sims.size(); ++i)
+        {
+            auto& sim = sims[i];
+            auto& panel = panels[i];
+            auto& state = sim.state;
+
+            if (!panel.isDone)
+            {
+                state.elapsed = clock.since(sim.epoch);
+
+                panel.status.clear();
+
+                if (state.elapsed < 0) {
+                    panel.status += "lagtime: ";
+                    appendSeconds(panel.status, -state.elapsed);
+                } else {
+                    updateTick(sim);
+
+                    if (isComplete(sim)) {
+                        panel.isDone = true;
+                        panel.status += "completion after ";
+                        appendSeconds(panel.status, state.elapsed + sim.drugInfo.lagtime);
+                    }
+                }
+            }
+
+            allDone = allDone && panel.isDone;
+
+            renderer.line(panel.firstLine + 1) = panel.status.empty() ? sim.cache.output :
+                                                                        panel.status;
+
+            if (panel.lines == 3) {
+                auto& altLine = renderer.line(panel.firstLine + 2);
+                if (panel.status.empty() && state.isMultiline) altLine = sim.cache.altOutput;
+                else altLine.clear();
+            }
+        }
+
+        if (showCombined)
+        {
+            double content = 0;
+
+            for (std::size_t i = 0; i < sims.size(); ++i) {
+                const auto& state = sims[i].state;
+                if (panels[i].isDone || !panels[i].status.empty())
+                    continue;
+                content += state.activeDrugContent.value_or(state.drugContent);
+            }
+
+            auto& combinedOutput = renderer.line(totalLines - 1);
+
+            combinedOutput.clear();
+            combinedOutput += "active drug content: ";
+            combinedOutput.appendFixed(content, combinedPrecision);
+            combinedOutput += ' ';
+            combinedOutput += combinedUnit;
+
+            if (combinedEd50 > 0) {
+                combinedOutput += " (eff. ";
+                combinedOutput.appendFixed(
+                    PK::computeEffectiveness(combinedEd50, content) * 100.0, 0
+                );
+                combinedOutput += "%)";
+            }
+        }
+
+        // Only changed lines are written, nothing if the dashboard is the same.
+        renderer.present();
+
+        if (allDone)
+            break;
+
+        clock.wait();
+    }
+
+    const std::size_t allocEnd = AllocCounter::count();
+
+    std::cout << "\n\nAll simulations complete. Press enter to exit.";
+    getchar();
+
+    std::cout << "\n";
+
+    if (sims.front().isAllocReportEnabled) {
+        reportAllocs(allocEnd - allocStart, ticks);
+    }
+}
+
+/*
+ * Evaluate the summed active drug of several simulations over the batch time
+ * grid, measured from the earliest administration. One line per sample.
+*/
+void startCombinedBatch(std::vector<SimulationInfo>& sims)
+{
+    for (auto& sim : sims) {
+        SimHelper::validateInit(sim);
+        startClock(sim);
+    }
+
+    const auto& grid = sims.front().batch.value();
+
+    if (grid.step <= 0 || grid.end < grid.start) {
+        throw std::invalid_argument("batch grid requires start <= end and step > 0");
+    }
+
+    const std::string_view unit = Combined::sharedUnit(sims);
+    const bool hasEffect = Combined::sharedEd50(sims) > 0;
+    const auto offsets = Combined::startOffsets(sims);
+
+    std::cout << "# combined:";
+    for (std::size_t i = 0; i < sims.size(); ++i) {
+        std::cout << std::format(" {}{} (start: {:.3f})", i ? "+ " : "",
+                                 sims[i].msg.value_or(std::format("simulation {}", i + 1)),
+                                 offsets[i]);
+    }
+    std::cout << std::format("\n# time\tactive drug content ({}){}\n", unit,
+                             hasEffect ? "\teffectiveness" : "");
+
+    std::vector<double> t(grid.size());
+    for (std::size_t i = 0; i < t.size(); ++i) {
+        t[i] = grid.at(i);
+    }
+
+    std::vector<double> content(t.size());
+    std::vector<double> effectiveness(hasEffect ? t.size() : 0);
+
+    Combined::evaluate(sims, t, content, effectiveness);
+
+    string buffer;
+    buffer.reserve(batchFlushSize + RenderBuffer::CAPACITY);
+    RenderBuffer row;
+
+    const std::size_t allocStart = AllocCounter::count();
+
+    for (std::size_t i = 0; i < t.size(); ++i)
+    {
+        row.clear();
+        row.appendFixed(t[i], 3);
+        row += '\t';
+        row.appendChars(content[i], std::chars_format::general, 6);
+        if (hasEffect) {
+            row += '\t';
+            row.appendFixed(effectiveness[i], 4);
+        }
+        row += '\n';
+
+        buffer += row.view();
+
+        if (buffer.size() >= batchFlushSize) {
+            std::cout.write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    }
+
+    const std::size_t allocEnd = AllocCounter::count();
+
+    std::cout.write(buffer.data(), buffer.size());
+    std::flush(std::cout);
+
+    if (sims.front().isAllocReportEnabled) {
+        reportAllocs(allocEnd - allocStart, t.size());
+    }
+}
+
+/*
+ * Evaluate every point of the batch time grid as fast as possible and write
+ * one line per sample, no clock or sleeping involved.
+ *
+ * @note: grid times are elapsed since the drug reached systemic circulation
+*/
+void startBatch(SimulationInfo& simInfo)
+{
+    using namespace SimHelper;
+
+    validateInit(simInfo);
+    startClock(simInfo);
+
+    const auto& grid = simInfo.batch.value();
+    auto& simState = simInfo.state;
+
+    if (grid.step <= 0 || grid.end < grid.start) {
+        throw std::invalid_argument("batch grid requires start <= end and step > 0");
+    }
+
+    if (simInfo.exportPath.has_value() && isColumnFilePath(*simInfo.exportPath)) {
+        writeBatchColumns(simInfo);
         return;
+    }
 
-    auto& drug = sim.drugInfo;
+    /* Exported samples replace the text rows. */
+    std::optional<SampleExporter> exporter;
+
+    if (simInfo.exportPath.has_value()) {
+        exporter.emplace(*simInfo.exportPath);
+        exporter->writeHeader();
+    }
+    else {
+        if (simInfo.msg.has_value()) {
+            std::cout << "# " << simInfo.msg.value() << '\n';
+        }
+        std::cout << std::format("# completion: {:.3f}\n", simInfo.events.completion);
+    }
 
-    double duration = (drug.lagtime + sim.epoch.count()) - getEpoch().count();
+    string buffer;
+    buffer.reserve(batchFlushSize + RenderBuffer::CAPACITY);
+    RenderBuffer row;
 
-    const string label = "lagtime: ";
+    const std::size_t samples = grid.size();
+    const std::size_t allocStart = AllocCounter::count();
 
-    while (duration > 0)
+    for (std::size_t i = 0; i < samples; ++i)
     {
-        std::cout << label << formatSeconds(duration) << std::flush;
+        // Index based time avoids accumulating error from repeated addition.
+        simState.elapsed = grid.at(i);
 
-        sleepFor(tickIntervalMs);
+        updateTick(simInfo, !exporter);
 
-        duration -= tickIntervalMs * 1e-3;
+        if (exporter) {
+            exporter->write(simInfo);
+            continue;
+        }
 
-        std::cout << lineReset << std::flush;
+        row.clear();
+        row.appendFixed(simState.elapsed, 3);
+        row += '\t';
+        row += simInfo.cache.output.view();
+        if (simState.isMultiline) {
+            row += '\t';
+            row += simInfo.cache.altOutput.view();
+        }
+        row += '\n';
+
+        buffer += row.view();
+
+        if (buffer.size() >= batchFlushSize) {
+            std::cout.write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    }
+
+    const std::size_t allocEnd = AllocCounter::count();
+
+    if (exporter) {
+        exporter->flush();
+    }
+
+    std::cout.write(buffer.data(), buffer.size());
+    std::flush(std::cout);
+
+    if (simInfo.isAllocReportEnabled) {
+        reportAllocs(allocEnd - allocStart, samples);
     }
+}
+
+/*
+ * Simulate the virtual population over the batch grid and write the
+ * percentile bands of drug content (active drug if prodrug) per time point.
+*/
+void startPopulation(SimulationInfo& simInfo)
+{
+    SimHelper::validateInit(simInfo);
+    startClock(simInfo);
+
+    const auto& pop = simInfo.population.value();
+
+    if (!simInfo.batch.has_value()) {
+        throw std::invalid_argument("population mode requires a batch grid");
+    }
+    else if (pop.subjects == 0) {
+        throw std::invalid_argument("population requires at least one subject");
+    }
+
+    const auto& grid = simInfo.batch.value();
+
+    if (grid.step <= 0 || grid.end < grid.start) {
+        throw std::invalid_argument("batch grid requires start <= end and step > 0");
+    }
+
+    std::vector<double> times(grid.size());
+    for (std::size_t i = 0; i < times.size(); ++i) {
+        times[i] = grid.at(i);
+    }
+
+    auto params = Population::sampleParams(simInfo);
+    auto bands = Population::simulate(simInfo, params, times);
+
+    if (simInfo.exportPath.has_value())
+    {
+        if (!isColumnFilePath(*simInfo.exportPath)) {
+            throw std::invalid_argument("population export requires a .bin path");
+        }
+
+        const string_view unit = simInfo.baseUnitsEnabled ? MGL_STR : MG_STR;
+        const ColumnSpec columns[] = {{"elapsed", "s"}, {"p5", unit}, {"p50", unit},
+                                      {"p95", unit}};
+
+        ColumnFileWriter writer(*simInfo.exportPath, simInfo, columns, times.size());
+
+        std::copy(times.begin(), times.end(), writer.column(0).begin());
+        for (std::size_t p = 0; p < std::size(bands.band); ++p) {
+            std::copy(bands.band[p].begin(), bands.band[p].end(), writer.column(p + 1).begin());
+        }
+
+        writer.close();
+        return;
+    }
+
+    if (simInfo.msg.has_value()) {
+        std::cout << "# " << simInfo.msg.value() << '\n';
+    }
+    std::cout << "# subjects: " << pop.subjects << '\n';
+    std::cout << "# time\tp5\tp50\tp95\n";
+
+    string buffer;
+    buffer.reserve(batchFlushSize + 512);
+
+    for (std::size_t i = 0; i < times.size(); ++i)
+    {
+        buffer += std::format(
+            "{:.3f}\t{:.6g}\t{:.6g}\t{:.6g}\n",
+            times[i], bands.band[0][i], bands.band[1][i], bands.band[2][i]
+        );
+
+        if (buffer.size() >= batchFlushSize) {
+            std::cout.write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    }
+
+    std::cout.write(buffer.data(), buffer.size());
+    std::flush(std::cout);
+}
+
+/* Print the steady state of the repeated dose, nothing is simulated. */
+void startSteadyState(SimulationInfo& simInfo)
+{
+    SimHelper::validateInit(simInfo);
+
+    const auto& drug = simInfo.drugInfo;
+
+    if (!drug.schedule.has_value() || drug.schedule->interval <= 0) {
+        throw std::invalid_argument("steady state requires a dose interval");
+    }
+
+    const double interval = drug.schedule->interval;
+
+    RenderBuffer out;
+
+    auto appendContent = [&](double content) {
+        if (simInfo.sigfigs.has_value()) appendSigFigs(out, content, *simInfo.sigfigs);
+        else out.appendFixed(content, simInfo.precision);
+
+        if (simInfo.doseUnitsEnabled) {
+            out += ' ';
+            out += simInfo.baseUnitsEnabled ? MGL_STR : MG_STR;
+        }
+    };
+
+    auto printSteadyState = [&](string_view name, const SteadyState& steady) {
+        out.clear();
+        out += name;
+        out += " max: ";
+        appendContent(steady.max);
+        out += " (";
+        appendSeconds(out, steady.tmax);
+        out += " after a dose)\n";
+        std::cout << out.view();
+
+        out.clear();
+        out += name;
+        out += " min: ";
+        appendContent(steady.min);
+        out += " (";
+        appendSeconds(out, steady.tmin);
+        out += " after a dose)\n";
+        std::cout << out.view();
+
+        out.clear();
+        out += name;
+        out += " average: ";
+        appendContent(steady.average);
+        out += '\n';
+        std::cout << out.view();
+
+        std::cout << std::format("{} accumulation ratio: {:.3g}\n", name, steady.accumulation);
+        std::cout << name << " 90% of steady state: " << formatSeconds(steady.timeTo90) << '\n';
+    };
+
+    if (simInfo.msg.has_value()) {
+        std::cout << "# " << simInfo.msg.value() << '\n';
+    }
+    std::cout << "# steady state every " << formatSeconds(interval) << '\n';
+
+    if (drug.isProdrug) {
+        printSteadyState("prodrug", computeSteadyState(drug, simInfo.compModel, interval));
+        printSteadyState("active drug", computeSteadyState(
+            drug, PK::computeActiveTerms(drug, simInfo.compModel), interval
+        ));
+    } else {
+        printSteadyState("drug", computeSteadyState(drug, simInfo.compModel, interval));
+    }
+
+    std::flush(std::cout);
+}
+
+/* Start the simulation now unless another start time was given. */
+void startClock(SimulationInfo& sim, std::chrono::duration<double> now)
+{
+    if (!sim.epoch.count()) {
+        sim.epoch = now;
+    }
+    // Add lagtime if the specified start time is ahead of current time.
+    else if (sim.epoch > now) {
+        sim.drugInfo.lagtime = (sim.epoch - now).count();
+        sim.epoch = now;
+    }
+}
+
+void startLag(SimulationInfo& sim, SimClock& clock)
+{
+    if (sim.drugInfo.lagtime <= 0)
+        return;
+
+    auto& drug = sim.drugInfo;
+
+    FrameRenderer renderer(1);
+    auto& text = renderer.line(0);
+    std::flush(std::cout);
+
+    // Remaining time is read from the clock each tick so it cannot drift.
+    for (double duration = drug.lagtime - clock.since(sim.epoch); duration > 0;
+         duration = drug.lagtime - clock.since(sim.epoch))
+    {
+        text.clear();
+        text += "lagtime: ";
+        appendSeconds(text, duration);
+
+        renderer.present();
+        clock.wait();
+    }
+
+    // The simulation output is drawn over the lagtime line.
+    text.clear();
+    renderer.present();
 
     sim.epoch += std::chrono::duration<double>(drug.lagtime);
 }
@@ -119,33 +700,68 @@ void printStartupText(SimulationInfo& sim)
 
     std::cout << "\ntime at administration: "
               << getTimeAndDateString(sim.epoch, sim.is12HrFormat) << "\n\n";
+}
+
+/* Stage the cached output lines of a simulation as lines of the frame. */
+void stageOutput(const SimulationInfo& sim, FrameRenderer& renderer)
+{
+    renderer.line(0) = sim.cache.output;
 
-    // Add extra line for more space to display other lines.
-    if (sim.state.isMultiline) {
-        std::cout << '\n';
+    if (renderer.lines.size() > 1) {
+        auto& altLine = renderer.line(1);
+        if (sim.state.isMultiline) altLine = sim.cache.altOutput;
+        else altLine.clear();
     }
 }
 
-void displayOutput(SimulationInfo& sim)
+/*
+ * Evaluate the batch time grid straight into the columns of a column file,
+ * only the columns the simulation has are written.
+*/
+void writeBatchColumns(SimulationInfo& simInfo)
 {
-    const bool& isMulti = sim.state.isMultiline;
-    const auto& output = sim.cache.output;
-    auto& altOutput = sim.cache.altOutput;
+    const auto& grid = simInfo.batch.value();
+    const auto& drug = simInfo.drugInfo;
+    const auto& state = simInfo.state;
 
-    if (isMulti) {
-        // Move line up, reset, and print output.
-        std::cout << lineUp << lineReset << output;
+    const string_view unit = simInfo.baseUnitsEnabled ? MGL_STR : MG_STR;
 
-        // Move line down, reset, and print second output.
-        std::cout << lineDown << lineReset << altOutput;
+    // Excreted active drug is an amount, otherwise divided by vd like the content.
+    const string_view excretedUnit = drug.isProdrug ? MG_STR : unit;
 
-        return;
+    std::vector<ColumnSpec> specs = {{"elapsed", "s"}, {"drug_content", unit}};
+    if (drug.isProdrug) specs.push_back({"active_drug_content", unit});
+    if (simInfo.displayExcreted) specs.push_back({"excreted", excretedUnit});
+    specs.push_back({"auc", "mg*h"});
+    if (simInfo.ed50Enabled) specs.push_back({"effectiveness", "fraction"});
+
+    const std::size_t samples = grid.size();
+    ColumnFileWriter writer(*simInfo.exportPath, simInfo, specs, samples);
+
+    std::vector<std::span<double>> columns;
+    for (std::size_t i = 0; i < specs.size(); ++i) {
+        columns.push_back(writer.column(i));
     }
-    else if (!altOutput.empty()) {
-        altOutput.clear();
-        std::cout << lineReset << lineUp;
+
+    for (std::size_t i = 0; i < samples; ++i)
+    {
+        simInfo.state.elapsed = grid.at(i);
+        SimHelper::updateTick(simInfo, false);
+
+        std::size_t c = 0;
+        columns[c++][i] = state.elapsed;
+        columns[c++][i] = state.drugContent;
+        if (drug.isProdrug) columns[c++][i] = *state.activeDrugContent;
+        if (simInfo.displayExcreted) columns[c++][i] = state.excreted;
+        columns[c++][i] = state.auc;
+        if (simInfo.ed50Enabled) columns[c++][i] = state.effectiveness;
     }
 
-    // Reset line and print output.
-    std::cout << lineReset << output;
+    writer.close();
+}
+
+/* Print heap allocations made by a simulation loop, ticks is the loop count. */
+void reportAllocs(std::size_t allocs, std::size_t ticks)
+{
+    std::cerr << std::format("heap allocations: {} in {} ticks\n", allocs, ticks);
 }
@@ -5,18 +5,15 @@
 #include "common.hpp"
 #include "pk_utils.hpp"
 #include "convert_utils.hpp"
-#include "time_utils.hpp"
+#include "event_solver.hpp"
 
 using std::string;
 
 using namespace PK;
-namespace OneComp = PK::OneCompartment;
 namespace TwoComp = PK::TwoCompartment;
 namespace Convert = UnitConverter;
 
-const double EPSILON_MULT = 1.00001;
-
-/* Validate everything is set up properly. */
+/* Validate everything is set up properly, the clock is not read here. */
 void SimHelper::validateInit(SimulationInfo& sim)
 {
     using namespace UnitConverter;
@@ -26,8 +23,6 @@ void SimHelper::validateInit(SimulationInfo& sim)
     auto& drug = sim.drugInfo;
 
     /* Reserve cache string sizes */
-    cache.output.reserve(128);
-    cache.altOutput.reserve(128);
     cache.doseUnitStr.reserve(3);
     cache.baseUnitStr.reserve(3);
     cache.fullDoseUnitStr.reserve(7);
@@ -40,8 +35,12 @@ void SimHelper::validateInit(SimulationInfo& sim)
     }
     cache.updateFullDoseUnitStr();
 
-    /* Flip absorption/elimination constants if flip-flop effect occurs. */
-    if (drug.ka > 0 && drug.ka < drug.ke) {
+    /*
+     * Flip absorption/elimination constants if flip-flop effect occurs, the
+     * curve only stays the same for linear elimination without a peripheral
+     * compartment.
+    */
+    if (drug.ka > 0 && drug.ka < drug.ke && !drug.hasPeripheral && !drug.isNonlinear) {
         double newKa = drug.ke;
         double newKe = drug.ka;
 
@@ -51,24 +50,24 @@ void SimHelper::validateInit(SimulationInfo& sim)
 
     if (drug.isProdrug) {
         state.isMultiline = true;
+    }
 
-        /* Ensure no rate constants are equal; prevent zero division. */
-        double& ka = drug.ka;
-        double& ke = drug.ke;
-        double& km = drug.activeKe.value();
-        if (ka == ke && ke == km) {
-            ka *= EPSILON_MULT;
-            ke *= EPSILON_MULT * EPSILON_MULT;
-        } else {
-            if (ka == ke) {
-                ke *= EPSILON_MULT;
-            }
-            if (ka == km) {
-                km *= EPSILON_MULT;
-            }
-            if (ke == km) {
-                km *= EPSILON_MULT;
-            }
+    /* Nonlinear elimination integrates doses as given, schedules included. */
+    if (drug.isNonlinear) {
+        drug.ke = *drug.vmax / (*drug.km * drug.vd);
+        sim.nonlinear = makeNonlinearModel(drug, sim.compModel);
+    }
+    else {
+        sim.model = makeLinearModel(drug, sim.compModel);
+    }
+
+    /* Superimpose dose schedule on the single dose curves. */
+    if (drug.schedule.has_value() && !drug.isNonlinear) {
+        sim.regimen = makeRegimenCurve(drug, computeDrugTerms(drug, sim.compModel));
+        if (drug.isProdrug) {
+            sim.activeRegimen = makeRegimenCurve(
+                drug, computeActiveTerms(drug, sim.compModel)
+            );
         }
     }
 
@@ -76,22 +75,21 @@ void SimHelper::validateInit(SimulationInfo& sim)
     if (drug.roa != ROA_TYPE_IV) {
         state.hasTmaxed = false;
         state.fullyAbsorbed = false;
-        drug.tmax = TwoComp::computeTmax(drug);
+        if (drug.isNonlinear) {
+            drug.tmax = EventSolver::timePeak(*sim.nonlinear);
+        }
+        else {
+            drug.tmax = drug.hasPeripheral ?
+                        EventSolver::timePeak(computeDrugTerms(drug, sim.compModel)) :
+                        TwoComp::computeTmax(drug);
+        }
     }
 
     if (sim.precision > 0) {
         state.minDisplayDose = getMinDisplayDose(sim.precision);
     }
 
-    if (!sim.epoch.count()) {
-        sim.epoch = getEpoch();
-    }
-    // Add lagtime if the specified start time is ahead of current time.
-    else if (sim.epoch > getEpoch()) {
-        auto epoch = getEpoch();
-        drug.lagtime = (sim.epoch - epoch).count();
-        sim.epoch = epoch;
-    }
+    sim.events = EventSolver::solve(sim);
 }
 
 double SimHelper::getMinDisplayDose(int prec)
@@ -104,73 +102,115 @@ double SimHelper::getMinDisplayDose(int prec)
  * Updates all drug and dose unit info for each simulation tick.
 */
 void SimHelper::updateCurrentDoses(SimulationInfo& sim)
+{
+    if (sim.regimen.has_value()) {
+        updateRegimenDoses(sim);
+        return;
+    }
+    else if (sim.nonlinear.has_value()) {
+        updateModelDoses(sim, sim.nonlinear->at(sim.state.elapsed, sim.state.cursor));
+        return;
+    }
+
+    updateModelDoses(sim, sim.model.at(sim.state.elapsed));
+}
+
+/*
+ * Same as updateCurrentDoses for a state of the single dose model, excreted
+ * and AUC follow from the eliminated amounts.
+*/
+void SimHelper::updateModelDoses(SimulationInfo& sim, const LinearModel::Vector& x)
 {
     const auto& drug = sim.drugInfo;
     auto& state = sim.state;
-    double& elapsed = state.elapsed;
-    double& drugContent = state.drugContent;
-    auto& activeDrugContent = state.activeDrugContent;
     double defUnitFactor = 1.0 / Convert::Dose::toDefaultFactor(state.doseUnit);
 
-    drugContent = computeDrugContent(sim, elapsed);
-    state.doseAsUnit = drugContent * defUnitFactor;
+    state.drugContent = x[LinearModel::STATE_CENTRAL] / drug.vd;
+    state.doseAsUnit = state.drugContent * defUnitFactor;
 
     if (drug.isProdrug) {
-        if (sim.compModel == ONE_COMP_MODEL)
-            activeDrugContent = OneComp::computeMetaboliteContent(drug, elapsed);
-        else if (sim.compModel == TWO_COMP_MODEL)
-            activeDrugContent = TwoComp::computeMetaboliteContent(drug, elapsed);
-        state.activeDoseAsUnit = *activeDrugContent * defUnitFactor;
+        state.activeDrugContent = x[LinearModel::STATE_ACTIVE];
+        state.activeDoseAsUnit = *state.activeDrugContent * defUnitFactor;
     }
 
-    // Updated effectiveness.
     if (sim.ed50Enabled) {
-        const double& dose = (drug.isProdrug) ? *activeDrugContent : drugContent;
+        const double& dose = drug.isProdrug ? *state.activeDrugContent :
+                                              state.drugContent;
         state.effectiveness = computeEffectiveness(drug.ed50, dose);
     }
 
-    // Update excreted.
+    if (!sim.displayExcreted && !sim.needsAuc())
+        return;
+
+    /* Prodrug reports the active drug, AUC is in hours like a schedule. */
+    const double eliminated = drug.isProdrug ? x[LinearModel::STATE_ACTIVE_ELIMINATED] :
+                                               x[LinearModel::STATE_ELIMINATED];
+    const double& k = drug.isProdrug ? *drug.activeKe : drug.ke;
+
     if (sim.displayExcreted) {
-        switch (sim.compModel) {
-            case ONE_COMP_MODEL:
-                if (drug.isProdrug) {
-                    state.excreted = OneComp::computeMetaboliteExcreted(drug, elapsed);
-                } else {
-                    state.excreted = OneComp::computeExcreted(drug, elapsed);
-                }
-                break;
-            case TWO_COMP_MODEL:
-                if (drug.isProdrug) {
-                    state.excreted = TwoComp::computeMetaboliteExcreted(drug, elapsed);
-                } else {
-                    state.excreted = TwoComp::computeExcreted(drug, elapsed);
-                }
-                break;
-        }
+        state.excreted = drug.excretionFrac * eliminated;
+        if (!drug.isProdrug) state.excreted /= drug.vd;
+    }
+
+    if (sim.needsAuc()) {
+        state.auc = eliminated / k / 3600;
+    }
+}
+
+/* Same as above for a state of the nonlinear model, its AUC is integrated. */
+void SimHelper::updateModelDoses(SimulationInfo& sim, const NonlinearModel::Vector& x)
+{
+    LinearModel::Vector linear;
+    std::copy_n(x.begin(), linear.size(), linear.begin());
+
+    updateModelDoses(sim, linear);
+
+    if (sim.needsAuc() && !sim.drugInfo.isProdrug) {
+        sim.state.auc = x[NonlinearModel::STATE_AREA] / 3600;
+    }
+}
+
+/*
+ * Same as updateCurrentDoses for a dose schedule, excreted and AUC follow
+ * from the integral of the schedule's curve.
+*/
+void SimHelper::updateRegimenDoses(SimulationInfo& sim)
+{
+    const auto& drug = sim.drugInfo;
+    auto& state = sim.state;
+    const double& elapsed = state.elapsed;
+    double defUnitFactor = 1.0 / Convert::Dose::toDefaultFactor(state.doseUnit);
+
+    const auto& regimen = sim.regimen.value();
+
+    state.drugContent = regimen.value(elapsed);
+    state.doseAsUnit = state.drugContent * defUnitFactor;
+
+    if (drug.isProdrug) {
+        state.activeDrugContent = sim.activeRegimen->value(elapsed);
+        state.activeDoseAsUnit = *state.activeDrugContent * defUnitFactor;
+    }
+
+    if (sim.ed50Enabled) {
+        const double& dose = drug.isProdrug ? *state.activeDrugContent :
+                                              state.drugContent;
+        state.effectiveness = computeEffectiveness(drug.ed50, dose);
     }
 
-    // Nothing more to do if auc is not enabled.
-    if (!sim.isAucEnabled)
+    if (!sim.displayExcreted && !sim.needsAuc())
         return;
 
-    // Compute area under curve.
-    switch (sim.compModel) {
-        case ONE_COMP_MODEL:
-            if (!drug.isProdrug) {
-                state.auc = OneComp::computeAuc(drug, drug.dose, elapsed);
-            } else {
-                state.auc = OneComp::computeMetaboliteAuc(drug, elapsed);
-            }
-            break;
-        case TWO_COMP_MODEL:
-            if (drug.isProdrug) {
-                state.auc = TwoComp::computeAucMetabolite(drug, elapsed);
-            } else if (drug.isDr) {
-                state.auc = TwoComp::computeAucDr(drug, drug.dose, elapsed);
-            } else {
-                state.auc = TwoComp::computeAuc(drug, drug.dose, elapsed);
-            }
-            break;
+    /* Prodrug reports the active drug, AUC is in hours like the single dose. */
+    const auto& curve = drug.isProdrug ? *sim.activeRegimen : regimen;
+    const double area = curve.integral(elapsed);
+
+    if (sim.displayExcreted) {
+        const double& k = drug.isProdrug ? *drug.activeKe : drug.ke;
+        state.excreted = drug.excretionFrac * k * area;
+    }
+
+    if (sim.needsAuc()) {
+        state.auc = (drug.isProdrug ? area : area * drug.vd) / 3600;
     }
 }
 
@@ -195,17 +235,26 @@ void SimHelper::checkTmaxState(SimulationInfo& sim)
 
     const auto& elapsed = sim.state.elapsed;
 
-    if (!state.hasTmaxed && elapsed >= drug.tmax) {
+    if (!state.hasTmaxed && elapsed >= sim.events.tmax) {
         state.hasTmaxed = true;
     }
 
-    if (drug.isDr && !state.hasDrTmaxed &&
-        elapsed >= drug.tmax + drug.drLagtime.value())
-    {
+    if (drug.isDr && !state.hasDrTmaxed && elapsed >= sim.events.drTmax) {
         state.hasDrTmaxed = true;
     }
 }
 
+/* Set delayed release state once the delayed dose has been released. */
+void SimHelper::checkDrReleased(SimulationInfo& sim)
+{
+    const auto& drug = sim.drugInfo;
+    auto& state = sim.state;
+
+    if (drug.isDr && !state.hasDrReleased && state.elapsed >= drug.drLagtime.value()) {
+        state.hasDrReleased = true;
+    }
+}
+
 /* Adjust dose and unit to a fixed precision. */
 void SimHelper::useFixedPrecision(SimulationInfo& sim)
 {
@@ -268,30 +317,62 @@ void SimHelper::checkFullyAbsorbed(SimulationInfo& sim)
     if (sim.state.fullyAbsorbed || sim.compModel == ONE_COMP_MODEL)
         return;
 
-    auto& drug = sim.drugInfo;
-
-    sim.state.fullyAbsorbed = TwoComp::computeIsAbsorbed(drug, sim.state.elapsed);
+    sim.state.fullyAbsorbed = sim.state.elapsed >= sim.events.absorbed;
 }
 
-/* Check if the dose is low enough to be considered complete. */
-bool SimHelper::isMinDose(SimulationInfo& sim)
+/*
+ * Run every update for the current elapsed time and rebuild the cached
+ * output (unless updateText is false), used by simulations that are not
+ * displayed one tick at a time.
+*/
+void SimHelper::updateTick(SimulationInfo& sim, bool updateText)
 {
-    auto& state = sim.state;
-    double& minAllowed = sim.minDoseAllowed;
-    double& minDisp = state.minDisplayDose;
+    updateCurrentDoses(sim);
+    checkDrReleased(sim);
+    checkFullyAbsorbed(sim);
+    checkTmaxState(sim);
+    checkMaxAchieved(sim);
+
+    if (updateText) {
+        useFixedPrecision(sim);
+        updateCache(sim);
+    }
+}
 
-    auto isMin = [&](double& dose, double& doseAsUnit) {
-        return dose < minAllowed || doseAsUnit < minDisp;
-    };
+/* Label of the drug (prodrug if used) phase. */
+std::string_view SimHelper::getPhaseLabel(const SimulationInfo& sim)
+{
+    const auto& state = sim.state;
+    const auto& schedule = sim.drugInfo.schedule;
 
-    if (!isMin(state.drugContent, state.doseAsUnit)) {
-        return false;
-    }
-    else if (sim.drugInfo.isProdrug) {
-        return isMin(*state.activeDrugContent, *state.activeDoseAsUnit);
+    if (schedule.has_value()) {
+        for (const auto& it : schedule->infusions) {
+            if (state.elapsed >= it.start && state.elapsed < it.start + it.duration)
+                return infusionPhaseLabel;
+        }
     }
 
-    return true;
+    if (state.hasTmaxed && !state.fullyAbsorbed)
+        return elPhaseAbsorbingLabel;
+
+    return state.hasTmaxed ? eliminationPhaseLabel : absorptionPhaseLabel;
+}
+
+/* Label of the delayed release portion's phase. */
+std::string_view SimHelper::getDrPhaseLabel(const SimulationInfo& sim)
+{
+    const auto& state = sim.state;
+
+    if (!state.hasDrReleased)
+        return lagPhaseLabel;
+
+    return state.hasDrTmaxed ? eliminationPhaseLabel : absorptionPhaseLabel;
+}
+
+/* Check if the simulation has reached its completion time. */
+bool SimHelper::isComplete(const SimulationInfo& sim)
+{
+    return sim.state.elapsed >= sim.events.completion;
 }
 
 /* Update simulations cached info for output. */
@@ -315,42 +396,34 @@ void SimHelper::updateCache(SimulationInfo& sim)
     double& minProdrugDisplayDose = state.minProdrugDisplayDose;
 
     // Label displayed adjacent to dose.
-    const std::string_view* label = nullptr;
+    const std::string_view label = getPhaseLabel(sim);
 
     /* Set dose unit string if it is empty */
     if (unitStr.empty()) {
         unitStr = Convert::unitToString<DOSE_UNIT>(state.doseUnit);
     }
 
-    /* Append unit for dose to end of output string. */
+    /* Append unit for dose to end of output. */
     auto appendUnitFn = [&]() {
         if (!sim.doseUnitsEnabled) return;
         out += ' ';
         out += sim.baseUnitsEnabled ? fullDoseUnitStr : unitStr;
     };
 
-    /* Append default unit to end of output string */
+    /* Append default unit to end of output */
     auto appendDefUnitFn = [&](){
         if (!sim.doseUnitsEnabled) return;
         out += ' ';
         out += sim.baseUnitsEnabled ? MGL_STR : MG_STR;
     };
 
-    /* Create label depending on drug (prodrug if used) phase. */
-    auto drugLabelFn = [&]() {
-        if (state.hasTmaxed && !state.fullyAbsorbed) {
-            label = &elPhaseAbsorbingLabel;
-            return;
-        }
-        label = state.hasTmaxed ? &eliminationPhaseLabel : &absorptionPhaseLabel;
-    };
-
-    /* Create string of value with given precision, use sigfigs instead of they are used. */
-    auto fmtPrecStr = [&](const double& content, const int& prec) {
+    /* Append value with given precision, use sigfigs instead if they are used. */
+    auto appendPrec = [&](RenderBuffer& buffer, const double& content, const int& prec) {
         if (sim.sigfigs.has_value()) {
-            return formatSigFigs(content, *sim.sigfigs);
+            appendSigFigs(buffer, content, *sim.sigfigs);
+            return;
         }
-        return std::format("{:.{}f}", content, prec);
+        buffer.appendFixed(content, prec);
     };
 
     /* Set minimum dose at which prodrug can be displayed */
@@ -359,20 +432,19 @@ void SimHelper::updateCache(SimulationInfo& sim)
     }
 
     if (drug.isProdrug) {
-        out = std::format(
-                "active drug content: {}",
-                fmtPrecStr(*state.activeDoseAsUnit, statePrec)
-        );
+        out.clear();
+        out += "active drug content: ";
+        appendPrec(out, *state.activeDoseAsUnit, statePrec);
         appendUnitFn();
 
         /* Prodrug multiline text */
         if (!state.fullyAbsorbed || state.drugContent >= minProdrugDisplayDose)
         {
-            drugLabelFn();
-            altOut = std::format(
-                    "prodrug ({}): {}",
-                    *label, fmtPrecStr(state.drugContent, sim.precision)
-            );
+            altOut.clear();
+            altOut += "prodrug (";
+            altOut += label;
+            altOut += "): ";
+            appendPrec(altOut, state.drugContent, sim.precision);
 
             if (unitsEnabled) {
                 altOut += ' ';
@@ -385,58 +457,54 @@ void SimHelper::updateCache(SimulationInfo& sim)
         }
     }
     else if (drug.isDr) {
-        drugLabelFn();
-        const auto* drLabel = state.hasDrTmaxed ? &eliminationPhaseLabel :
-                                                  &absorptionPhaseLabel;
-        if (!state.hasDrReleased) {
-            drLabel = &lagPhaseLabel;
-        }
-
-        out = std::format(
-            "drug content ({}[DR: {}]): {}",
-            *label, *drLabel, fmtPrecStr(dose, statePrec)
-        );
+        out.clear();
+        out += "drug content (";
+        out += label;
+        out += "[DR: ";
+        out += getDrPhaseLabel(sim);
+        out += "]): ";
+        appendPrec(out, dose, statePrec);
         appendUnitFn();
     }
     else {
-        drugLabelFn();
-        out = std::format("drug content ({}): {}", *label, fmtPrecStr(dose, statePrec));
+        out.clear();
+        out += "drug content (";
+        out += label;
+        out += "): ";
+        appendPrec(out, dose, statePrec);
         appendUnitFn();
     }
 
     // Display excreted.
     if (sim.displayExcreted) {
-        out += std::format(" (excreted: {}", fmtPrecStr(state.excreted, sim.precision));
+        out += " (excreted: ";
+        appendPrec(out, state.excreted, sim.precision);
         appendDefUnitFn();
         out += ')';
     }
 
     // Display max dose achieved.
     if (sim.isMaxStatEnabled) {
-        out += std::format(" (max achieved {}", fmtPrecStr(state.maxAchieved, sim.precision));
+        out += " (max achieved ";
+        appendPrec(out, state.maxAchieved, sim.precision);
         appendDefUnitFn();
         out += ')';
     }
 
-    // Display auc.
+    // Display auc, of the amount so never divided by vd.
     if (sim.isAucEnabled) {
-        out += std::format(" (AUC: {}", fmtPrecStr(state.auc, sim.precision));
-
-        if (sim.doseUnitsEnabled) {
-            appendDefUnitFn();
-        }
-        else {
-            out += " unit";
-        }
+        out += " (AUC: ";
+        appendPrec(out, state.auc, sim.precision);
 
-        out += "\u22C5h/L)";
+        out += ' ';
+        out += sim.doseUnitsEnabled ? MG_STR : "unit";
+        out += "\u22C5h)";
     }
 
     // Display effectiveness.
     if (sim.ed50Enabled) {
-        out += std::format(
-            " (eff. {:.0f}%)",
-            state.effectiveness * 100.0f
-        );
+        out += " (eff. ";
+        out.appendFixed(state.effectiveness * 100.0f, 0);
+        out += "%)";
     }
 }
@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include "pch.hpp"
+#include "steady_state.hpp"
+#include "pk_utils.hpp"
+
+using std::exp;
+using std::expm1;
+using std::size_t;
+
+namespace
+{
+    constexpr double STEADY_FRACTION = 0.9;
+    constexpr int MAX_ITERATIONS = 200;
+    constexpr double TIME_TOLERANCE = 1e-9; // relative, in seconds
+
+    // Parts of a piece searched for a turning point, more than its terms allow.
+    constexpr int SEARCH_PARTS = 64;
+
+    /* Part of every dose given delay after it, the delayed release portion. */
+    struct Portion {
+        double delay = 0;
+        double dose = 0;
+    };
+
+    std::vector<Portion> dosePortions(const DrugInfo& drug)
+    {
+        if (!drug.isDr)
+            return {{0, drug.dose}};
+
+        const double drFrac = drug.drFrac.value();
+        return {{0, drug.dose * (1 - drFrac)}, {drug.drLagtime.value(), drug.dose * drFrac}};
+    }
+
+    /* Time within [lo, hi] the sign of the derivative changes, by bisection. */
+    double findTurn(const ExpTerms& terms, double lo, double hi)
+    {
+        const bool isRising = terms.derivative(lo) > 0;
+
+        for (int i = 0; i < MAX_ITERATIONS && hi - lo > TIME_TOLERANCE * std::max(1.0, hi); ++i)
+        {
+            const double t = 0.5 * (lo + hi);
+            if ((terms.derivative(t) > 0) == isRising) lo = t;
+            else hi = t;
+        }
+        return 0.5 * (lo + hi);
+    }
+
+    /* Area of every portion of the first dose from 0 to t. */
+    double areaOfFirstDose(const ExpTerms& unitCurve, const std::vector<Portion>& portions,
+                           double t)
+    {
+        double area = 0.0;
+        for (const auto& it : portions) {
+            if (t > it.delay) area += it.dose * unitCurve.integral(t - it.delay);
+        }
+        return area;
+    }
+}
+
+/*
+ * Steady state of the single dose curve per milligram (unitCurve) repeated
+ * every interval. Each portion of the dose adds its terms summed over every
+ * past dose, c * exp(-r * u) / (1 - exp(-r * interval)) at time u since its
+ * last release, so one interval splits into pieces wherever a portion is
+ * released. A piece may fall before it rises, e.g. active drug formed from a
+ * prodrug, so its turning points are searched over the whole piece.
+*/
+SteadyState computeSteadyState(const DrugInfo& drug, const ExpTerms& unitCurve,
+                               double interval)
+{
+    if (interval <= 0)
+        throw std::invalid_argument("steady state requires a dose interval greater than 0");
+    else if (drug.dose <= 0)
+        throw std::invalid_argument("steady state requires a dose greater than 0");
+
+    const auto portions = dosePortions(drug);
+
+    SteadyState steady;
+    steady.interval = interval;
+
+    /* Release times within one interval, each one starts a piece. */
+    std::vector<double> starts{0.0};
+    for (const auto& it : portions) {
+        starts.push_back(std::fmod(it.delay, interval));
+    }
+    std::sort(starts.begin(), starts.end());
+    starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+
+    steady.min = std::numeric_limits<double>::infinity();
+
+    for (size_t i = 0; i < starts.size(); ++i)
+    {
+        const double start = starts[i];
+        const double duration = (i + 1 < starts.size() ? starts[i + 1] : interval) - start;
+
+        ExpTerms piece;
+        for (size_t k = 0; k < unitCurve.size; ++k)
+        {
+            const double rate = unitCurve.rate[k];
+            double coef = 0.0;
+
+            for (const auto& it : portions) {
+                const double phase = std::fmod(it.delay, interval);
+                const double since = start >= phase ? start - phase : start - phase + interval;
+                coef += it.dose * exp(-rate * since);
+            }
+
+            piece.add(unitCurve.coef[k] * coef / -expm1(-rate * interval), rate);
+        }
+
+        // Either end or a turning point, the end is right before a release.
+        auto check = [&](double t) {
+            const double value = piece.at(t);
+            if (value > steady.max) {
+                steady.max = value;
+                steady.tmax = start + t;
+            }
+            if (value < steady.min) {
+                steady.min = value;
+                steady.tmin = start + t;
+            }
+        };
+
+        check(0);
+        check(duration);
+
+        for (int j = 0; j < SEARCH_PARTS; ++j)
+        {
+            const double lo = duration * j / SEARCH_PARTS;
+            const double hi = duration * (j + 1) / SEARCH_PARTS;
+
+            if ((piece.derivative(lo) > 0) != (piece.derivative(hi) > 0)) {
+                check(findTurn(piece, lo, hi));
+            }
+        }
+    }
+
+    /* The area of one interval at steady state is the area of a whole dose. */
+    const double total = areaOfFirstDose(unitCurve, portions,
+                                         std::numeric_limits<double>::infinity());
+
+    steady.average = total / interval;
+    steady.accumulation = total / areaOfFirstDose(unitCurve, portions, interval);
+
+    /*
+     * The average of the interval ending at t is the area of the first dose
+     * up to t over the interval, so 90% of steady state is reached once 90%
+     * of the first dose's area is.
+    */
+    const double target = STEADY_FRACTION * total;
+    auto isReached = [&](double t) { return areaOfFirstDose(unitCurve, portions, t) >= target; };
+
+    double slowest = unitCurve.rate[0];
+    for (size_t k = 1; k < unitCurve.size; ++k) {
+        slowest = std::min(slowest, unitCurve.rate[k]);
+    }
+
+    double lo = 0.0;
+    double hi = portions.back().delay + 1.0 / slowest;
+
+    for (int i = 0; i < MAX_ITERATIONS && !isReached(hi); ++i) {
+        lo = hi;
+        hi *= 2;
+    }
+
+    for (int i = 0; i < MAX_ITERATIONS && hi - lo > TIME_TOLERANCE * std::max(1.0, hi); ++i)
+    {
+        const double t = 0.5 * (lo + hi);
+        if (isReached(t)) hi = t;
+        else lo = t;
+    }
+
+    steady.timeTo90 = hi;
+
+    return steady;
+}
+
+/* Steady state of the drug content (prodrug if used). */
+SteadyState computeSteadyState(const DrugInfo& drug, COMP_MODEL model, double interval)
+{
+    if (drug.isNonlinear)
+        throw std::logic_error("steady state requires linear elimination");
+
+    return computeSteadyState(drug, PK::computeDrugTerms(drug, model), interval);
+}
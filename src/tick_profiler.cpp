@@ -0,0 +1,90 @@
+#include <bit>
+#include "pch.hpp"
+#include "tick_profiler.hpp"
+
+namespace
+{
+    constexpr std::size_t HALF = LatencyHistogram::SUB_COUNT / 2;
+
+    const char* stageNames[PROFILE_STAGE_COUNT] = {
+        "updateCurrentDoses",
+        "checkMaxAchieved",
+        "useFixedPrecision",
+        "updateCache",
+        "display",
+        "sleep",
+        "tick (without sleep)",
+    };
+
+    std::string formatNs(std::uint64_t ns)
+    {
+        if (ns < 10'000)
+            return std::format("{} ns", ns);
+        else if (ns < 10'000'000)
+            return std::format("{:.1f} us", ns / 1e3);
+        return std::format("{:.1f} ms", ns / 1e6);
+    }
+}
+
+/*
+ * Values of bucket b >= 1 are shifted right by b, leaving a sub bucket in
+ * [SUB_COUNT/2, SUB_COUNT).
+*/
+std::size_t LatencyHistogram::bucketOf(std::uint64_t ns)
+{
+    const int shift = std::bit_width(ns >> SUB_BITS);
+    return shift * HALF + (ns >> shift);
+}
+
+std::uint64_t LatencyHistogram::highestInBucket(std::size_t bucket)
+{
+    if (bucket < SUB_COUNT)
+        return bucket;
+
+    const int shift = bucket / HALF - 1;
+    const std::uint64_t sub = bucket - shift * HALF;
+
+    return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(std::uint64_t ns)
+{
+    ++counts[bucketOf(ns)];
+    ++total;
+    max = std::max(max, ns);
+}
+
+/* Value at or below which fraction q of the values lie, within a bucket's width. */
+std::uint64_t LatencyHistogram::percentile(double q) const
+{
+    if (total == 0)
+        return 0;
+
+    const std::uint64_t rank = std::max<std::uint64_t>(1, std::ceil(q * total));
+    std::uint64_t seen = 0;
+
+    for (std::size_t i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= rank)
+            return std::min(highestInBucket(i), max);
+    }
+
+    return max;
+}
+
+void TickProfiler::report(std::ostream& out) const
+{
+    if (!isEnabled)
+        return;
+
+    out << std::format("{:<22}{:>12}{:>12}{:>12}{:>10}\n", "stage", "p50", "p99", "max", "count");
+
+    for (int i = 0; i < PROFILE_STAGE_COUNT; ++i)
+    {
+        const auto& hist = stages[i];
+
+        out << std::format("{:<22}{:>12}{:>12}{:>12}{:>10}\n", stageNames[i],
+                           formatNs(hist.percentile(0.50)), formatNs(hist.percentile(0.99)),
+                           formatNs(hist.max), hist.total);
+    }
+}
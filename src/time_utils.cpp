@@ -1,6 +1,5 @@
 #include <thread>
 #include <cassert>
-#include <regex>
 #include "pch.hpp"
 #include "time_utils.hpp"
 
@@ -112,24 +111,87 @@ string getTimeAndDateString(std::chrono::duration<double> epoch, bool is12HrForm
     return std::vformat(fmt, std::make_format_args(tp));
 }
 
-std::chrono::duration<double> hhmmToSeconds(string hhmm)
+std::chrono::duration<double> hhmmToSeconds(std::string_view hhmm)
 {
-    std::regex re{R"((\d{2}):?(\d{2})(?::(\d{2}))?)"};
-    std::smatch match;
+    auto isDigit = [&](std::size_t i) {
+        return i < hhmm.size() && hhmm[i] >= '0' && hhmm[i] <= '9';
+    };
+    auto twoDigits = [&](std::size_t i) {
+        return (hhmm[i] - '0') * 10 + (hhmm[i + 1] - '0');
+    };
+
+    // First match of "hh:?mm(:ss)?".
+    for (std::size_t i = 0; i < hhmm.size(); ++i)
+    {
+        if (!isDigit(i) || !isDigit(i + 1))
+            continue;
+
+        std::size_t m = i + 2;
+        if (m < hhmm.size() && hhmm[m] == ':' && isDigit(m + 1) && isDigit(m + 2))
+            ++m;
+        else if (!isDigit(m) || !isDigit(m + 1))
+            continue;
+
+        const std::size_t s = m + 2;
+        const bool hasSeconds = s < hhmm.size() && hhmm[s] == ':' && isDigit(s + 1) && isDigit(s + 2);
+
+        return chronoSeconds(twoDigits(i) * 3600 + twoDigits(m) * 60 +
+                             (hasSeconds ? twoDigits(s + 1) : 0));
+    }
+
+    throw std::invalid_argument("invalid hhmm format");
+}
+
+TickScheduler::TickScheduler(double rateHz)
+{
+    if (rateHz <= 0)
+        throw std::invalid_argument("tick rate must be greater than 0");
+
+    period = duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / rateHz));
+    next = clock::now() + period;
+}
+
+/* Sleep until the next deadline. */
+void TickScheduler::wait()
+{
+    std::this_thread::sleep_until(next);
 
-    if (!std::regex_search(hhmm, match, re)) {
-        throw std::invalid_argument("invalid hhmm format");
+    next += period;
+
+    // Skip deadlines that already passed (e.g. process was suspended).
+    auto now = clock::now();
+    if (next < now) {
+        next += period * ((now - next) / period + 1);
     }
+}
 
-    int h = stoi(match[1].str());
-    int m = stoi(match[2].str());
-    int s = match[3].matched ? stoi(match[3].str()) : 0;
+SimClock::SimClock(CLOCK_MODE mode, double speed, double rateHz)
+    : mode(mode), speed(speed), step(speed / rateHz), origin(getEpoch()),
+      realOrigin(TickScheduler::clock::now()), ticker(rateHz)
+{
+    if (speed <= 0)
+        throw std::invalid_argument("clock speed must be greater than 0");
+}
 
-    return chronoSeconds(h * 3600 + m * 60 + s);
+/* Clock time since the clock was started. */
+SimClock::seconds SimClock::elapsed() const
+{
+    switch (mode) {
+        case CLOCK_VIRTUAL:
+            return step * static_cast<double>(ticks);
+        case CLOCK_SCALED:
+            return speed * seconds(TickScheduler::clock::now() - realOrigin);
+        default:
+            return getEpoch() - origin;
+    }
 }
 
-/* Sleep for n milliseconds */
-void sleepFor(int ms)
+/* Wait for the next tick, a virtual clock only advances. */
+void SimClock::wait()
 {
-    std::this_thread::sleep_for(chronoMs(ms));
+    ++ticks;
+
+    if (mode != CLOCK_VIRTUAL) {
+        ticker.wait();
+    }
 }
@@ -0,0 +1,165 @@
+#include <cmath>
+#include <iterator>
+#include "vec_math.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VEC_MATH_X86 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    using ExpKernel = void (*)(const double*, double*, std::size_t);
+
+    /*
+     * exp(x) = 2^n * exp(r), where n = round(x / ln2) and |r| <= ln2 / 2.
+     * exp(r) uses a degree 13 taylor polynomial which is below 1e-16 relative
+     * error on that range.
+    */
+    constexpr double LOG2E = 1.4426950408889634074;
+    constexpr double LN2_HI = 6.93147180369123816490e-01;
+    constexpr double LN2_LO = 1.90821492927058770002e-10;
+    constexpr double ROUND_MAGIC = 0x1.8p52; // adding this rounds to an integer
+    constexpr double EXP_MAX = 709.0;        // above this 2^n may overflow
+    constexpr double EXP_MIN = -708.0;       // below this 2^n may be subnormal
+    constexpr double EXP_CLAMP_MAX = 710.0;  // exp overflows to inf past this
+    constexpr double EXP_CLAMP_MIN = -746.0; // exp underflows to 0 past this
+
+    // 1/k! for k = 13..0, in horner order.
+    constexpr double EXP_COEFS[] = {
+        1.0 / 6227020800.0, 1.0 / 479001600.0, 1.0 / 39916800.0,
+        1.0 / 3628800.0, 1.0 / 362880.0, 1.0 / 40320.0, 1.0 / 5040.0,
+        1.0 / 720.0, 1.0 / 120.0, 1.0 / 24.0, 1.0 / 6.0, 0.5, 1.0, 1.0,
+    };
+
+    void expScalar(const double* x, double* out, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i) {
+            out[i] = std::exp(x[i]);
+        }
+    }
+
+#ifdef VEC_MATH_X86
+    __attribute__((target("avx2,fma")))
+    void expAvx2(const double* x, double* out, std::size_t n)
+    {
+        const __m256d log2e = _mm256_set1_pd(LOG2E);
+        const __m256d magic = _mm256_set1_pd(ROUND_MAGIC);
+        const __m256d ln2Hi = _mm256_set1_pd(LN2_HI);
+        const __m256d ln2Lo = _mm256_set1_pd(LN2_LO);
+        const __m256d maxX = _mm256_set1_pd(EXP_MAX);
+        const __m256d minX = _mm256_set1_pd(EXP_MIN);
+        const __m256i bias = _mm256_set1_epi64x(1023);
+
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            __m256d v = _mm256_loadu_pd(x + i);
+
+            __m256d t = _mm256_fmadd_pd(v, log2e, magic);
+            __m256d k = _mm256_sub_pd(t, magic);
+
+            __m256d r = _mm256_fnmadd_pd(k, ln2Hi, v);
+            r = _mm256_fnmadd_pd(k, ln2Lo, r);
+
+            __m256d p = _mm256_set1_pd(EXP_COEFS[0]);
+            for (std::size_t c = 1; c < std::size(EXP_COEFS); ++c) {
+                p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(EXP_COEFS[c]));
+            }
+
+            // Integer bits of t minus the magic bits is k, shift into exponent.
+            __m256i kBits = _mm256_sub_epi64(_mm256_castpd_si256(t),
+                                             _mm256_castpd_si256(magic));
+            __m256i scale = _mm256_slli_epi64(_mm256_add_epi64(kBits, bias), 52);
+
+            // Lanes out of the fast range (rare) are redone with std::exp, from
+            // a copy of the input since out may be x.
+            __m256d outside = _mm256_or_pd(_mm256_cmp_pd(v, maxX, _CMP_GT_OQ),
+                                           _mm256_cmp_pd(v, minX, _CMP_LT_OQ));
+            if (_mm256_movemask_pd(outside)) {
+                double lanes[4];
+                _mm256_storeu_pd(lanes, v);
+                expScalar(lanes, out + i, 4);
+                continue;
+            }
+
+            _mm256_storeu_pd(out + i, _mm256_mul_pd(p, _mm256_castsi256_pd(scale)));
+        }
+
+        expScalar(x + i, out + i, n - i);
+    }
+
+    // GCC 12 warns about the undefined vectors inside its own avx512 headers.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+    /* Same as expAvx2, scalef applies 2^n and handles overflow and subnormals. */
+    __attribute__((target("avx512f")))
+    void expAvx512(const double* x, double* out, std::size_t n)
+    {
+        const __m512d log2e = _mm512_set1_pd(LOG2E);
+        const __m512d magic = _mm512_set1_pd(ROUND_MAGIC);
+        const __m512d ln2Hi = _mm512_set1_pd(LN2_HI);
+        const __m512d ln2Lo = _mm512_set1_pd(LN2_LO);
+        const __m512d maxX = _mm512_set1_pd(EXP_CLAMP_MAX);
+        const __m512d minX = _mm512_set1_pd(EXP_CLAMP_MIN);
+
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m512d v = _mm512_loadu_pd(x + i);
+            v = _mm512_max_pd(minX, _mm512_min_pd(maxX, v)); // keeps NaN
+
+            __m512d k = _mm512_sub_pd(_mm512_fmadd_pd(v, log2e, magic), magic);
+
+            __m512d r = _mm512_fnmadd_pd(k, ln2Hi, v);
+            r = _mm512_fnmadd_pd(k, ln2Lo, r);
+
+            __m512d p = _mm512_set1_pd(EXP_COEFS[0]);
+            for (std::size_t c = 1; c < std::size(EXP_COEFS); ++c) {
+                p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(EXP_COEFS[c]));
+            }
+
+            _mm512_storeu_pd(out + i, _mm512_scalef_pd(p, k));
+        }
+
+        expScalar(x + i, out + i, n - i);
+    }
+
+#pragma GCC diagnostic pop
+#endif
+
+    struct KernelChoice {
+        ExpKernel fn;
+        const char* name;
+    };
+
+    KernelChoice selectExpKernel()
+    {
+#ifdef VEC_MATH_X86
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("avx512f"))
+            return {expAvx512, "avx512"};
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            return {expAvx2, "avx2"};
+#endif
+        return {expScalar, "scalar"};
+    }
+
+    const KernelChoice& expKernel()
+    {
+        static const KernelChoice choice = selectExpKernel();
+        return choice;
+    }
+}
+
+void VecMath::exp(const double* x, double* out, std::size_t n)
+{
+    expKernel().fn(x, out, n);
+}
+
+const char* VecMath::expKernelName()
+{
+    return expKernel().name;
+}
@@ -0,0 +1,204 @@
+#include <cmath>
+#include <functional>
+#include "pch.hpp"
+#include "drugsim.hpp"
+#include "event_solver.hpp"
+
+/*
+ * Regression checks of the closed forms against evaluation on a dense time
+ * grid, each check prints its result and any failure makes the exit code 1.
+ *
+ * usage: drugsim_check [name]   (only the checks containing name)
+*/
+
+using std::string;
+
+namespace
+{
+    constexpr double HOUR = 3600;
+    constexpr double GRID_STEP = 60;
+
+    /* Last grid time either the drug or its active drug is above threshold. */
+    double sampledCompletion(const SimulationInfo& sim, double end)
+    {
+        const double threshold = EventSolver::completionThreshold(sim);
+        const auto samples = DrugSim::evaluate(sim, SimulationInfo::TimeGrid{0, end, GRID_STEP});
+
+        double last = 0;
+        for (size_t i = 0; i < samples.size(); ++i)
+        {
+            const bool isActiveAbove = !samples.activeDrugContent.empty() &&
+                                       samples.activeDrugContent[i] > threshold;
+
+            if (samples.drugContent[i] > threshold || isActiveAbove)
+                last = samples.elapsed[i];
+        }
+        return last;
+    }
+
+    /* Completion lies within one grid step after the last time sampled above. */
+    string checkCompletion(const DrugSim::DrugParams& params)
+    {
+        const auto sim = DrugSim::makeSimulation(params);
+        const double completion = sim.events.completion;
+        const double sampled = sampledCompletion(sim, 2 * completion + 48 * HOUR);
+
+        if (completion < sampled || completion > sampled + GRID_STEP) {
+            return std::format("completion {:.1f} s, sampled {:.1f} s", completion, sampled);
+        }
+        return "";
+    }
+
+    /* Summed active content of a lone simulation equals its own active content. */
+    string checkCombined(const DrugSim::DrugParams& params, const std::vector<double>& t)
+    {
+        const std::vector<SimulationInfo> sims{DrugSim::makeSimulation(params)};
+        const auto samples = DrugSim::evaluate(sims.front(), t);
+
+        std::vector<double> combined(t.size());
+        Combined::evaluate(sims, t, combined, {});
+
+        for (size_t i = 0; i < t.size(); ++i)
+        {
+            const double expected = samples.activeDrugContent[i];
+            if (std::fabs(combined[i] - expected) > 1e-9 * std::max(1.0, expected)) {
+                return std::format("{:.6f} mg at {:.0f} s, expected {:.6f} mg",
+                                   combined[i], t[i], expected);
+            }
+        }
+        return "";
+    }
+
+    /* Schedule of overlapping infusions against each infusion integrated alone. */
+    string checkInfusions()
+    {
+        DrugSim::DrugParams params;
+        params.dose = 0;
+        params.halfLife = 6 * HOUR;
+        params.distributionHalfLife = 1 * HOUR;
+        params.redistributionHalfLife = 2 * HOUR;
+
+        auto& infusions = params.schedule.emplace().infusions;
+        infusions = {{0, 2 * HOUR, 0.01}, {1 * HOUR, 30 * 60, 0.02}, {8 * HOUR, 4 * HOUR, 0.005}};
+
+        const auto sim = DrugSim::makeSimulation(params);
+        const auto& curve = sim.regimen.value();
+        const auto& unitCurve = curve.terms;
+
+        for (double t = 0; t < 24 * HOUR; t += 10 * 60)
+        {
+            double expected = 0;
+            for (const auto& it : infusions)
+            {
+                if (t <= it.start)
+                    continue;
+
+                const double end = std::min(t, it.start + it.duration);
+                for (size_t k = 0; k < unitCurve.size; ++k) {
+                    const double rate = unitCurve.rate[k];
+                    expected += unitCurve.coef[k] * it.rate / rate *
+                                (std::exp(-rate * (t - end)) - std::exp(-rate * (t - it.start)));
+                }
+            }
+
+            if (std::fabs(curve.value(t) - expected) > 1e-9 * std::max(1.0, expected)) {
+                return std::format("{:.9f} mg at {:.0f} s, expected {:.9f} mg",
+                                   curve.value(t), t, expected);
+            }
+        }
+        return "";
+    }
+
+    /* Dense closed forms against the linear model sampled one point at a time. */
+    string checkDenseContent(const DrugSim::DrugParams& params)
+    {
+        const auto sim = DrugSim::makeSimulation(params);
+
+        std::vector<double> t;
+        for (double it = 0; it <= 48 * HOUR; it += 7 * 60) t.push_back(it);
+
+        std::vector<double> dense(t.size());
+        computeDrugContent(sim, t, dense);
+
+        for (size_t i = 0; i < t.size(); ++i)
+        {
+            const double expected = computeDrugContent(sim, t[i]);
+            if (std::fabs(dense[i] - expected) > 1e-9 * std::max(1.0, expected)) {
+                return std::format("{:.9f} mg at {:.0f} s, expected {:.9f} mg",
+                                   dense[i], t[i], expected);
+            }
+        }
+        return "";
+    }
+
+    DrugSim::DrugParams oralProdrug()
+    {
+        DrugSim::DrugParams params;
+        params.roa = ROA_TYPE_ORAL;
+        params.dose = 70;
+        params.bioavailability = 0.964f;
+        params.absorptionHalfLife = 1 * HOUR;
+        params.halfLife = 1 * HOUR;
+        params.activeFrac = 0.297f;
+        params.activeHalfLife = 10 * HOUR;
+        return params;
+    }
+
+    DrugSim::DrugParams delayedProdrug()
+    {
+        auto params = oralProdrug();
+        params.halfLife = 2 * HOUR;
+        params.activeHalfLife = 4 * HOUR;
+        params.drFrac = 0.5f;
+        params.drLagtime = 4 * HOUR;
+        return params;
+    }
+
+    const std::vector<std::pair<string, std::function<string()>>> checks = {
+        {"completion/prodrug-long-metabolite", [] {
+            return checkCompletion(oralProdrug());
+        }},
+        {"completion/delayed-release-prodrug", [] {
+            return checkCompletion(delayedProdrug());
+        }},
+        {"regimen/overlapping-infusions", checkInfusions},
+        {"dense/iv", [] {
+            DrugSim::DrugParams params;
+            params.dose = 100;
+            params.halfLife = 6 * HOUR;
+            params.vd = 40;
+            return checkDenseContent(params);
+        }},
+        {"dense/oral-equal-rates", [] {
+            return checkDenseContent(oralProdrug());
+        }},
+        {"dense/delayed-release", [] {
+            return checkDenseContent(delayedProdrug());
+        }},
+        {"combined/delayed-release-prodrug", [] {
+            // Before and after the delayed portion is released at 4 h.
+            return checkCombined(delayedProdrug(), {1 * HOUR, 3 * HOUR, 4 * HOUR,
+                                                    5 * HOUR, 12 * HOUR, 30 * HOUR});
+        }},
+    };
+}
+
+int main(int argc, char* argv[])
+{
+    const std::string_view filter = argc > 1 ? argv[1] : "";
+
+    int failures = 0;
+
+    for (const auto& [name, check] : checks)
+    {
+        if (name.find(filter) == string::npos)
+            continue;
+
+        const string error = check();
+        std::cout << std::format("{:<48} {}\n", name, error.empty() ? "ok" : "FAILED " + error);
+
+        if (!error.empty()) ++failures;
+    }
+
+    return failures == 0 ? 0 : 1;
+}